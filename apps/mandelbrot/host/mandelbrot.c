@@ -120,6 +120,7 @@ MandelbrotImage::MandelbrotImage(json &j) {
   enableTimer(0);
 
   depth_array = right_depth_array = NULL;
+  own_depth_array = true;
   fractional_depth_array = right_fractional_depth_array = NULL;
   color_array = right_color_array = NULL;
   pixel_data = NULL;
@@ -314,9 +315,7 @@ MandelbrotImage::MandelbrotImage(json &j) {
 #ifdef KERNEL_AVAIL
   if (fpga) {
     cout << "Adjusting image sizes for FPGA (if needed)." << endl;
-    // FPGA has an upper bound on image size. I don't think this shrinkage will break anything catastrophically, but it's not tested.
-    if (calc_width > COLS) {calc_width = COLS;}
-    if (calc_height > ROWS) {calc_height = ROWS;}
+    // Image size is bounded only by the kernel's device buffer cap (see HW_Kernel::initialize_kernel).
 
     // TODO: I think there's currently a limitation that width must be a multiple of 16 for the FPGA.
     //       We will generate an image with width extended to a multiple of 16, where the extended pixels
@@ -336,12 +335,11 @@ MandelbrotImage::MandelbrotImage(json &j) {
 
 
 MandelbrotImage::~MandelbrotImage() {
-  if (depth_array != NULL) {
-    free(depth_array);
-  }
-  if (right_depth_array != NULL) {
-    free(right_depth_array);
+  // Depth arrays are pooled (unless provided by the kernel).
+  if (own_depth_array) {
+    BufferPool::shared().release(depth_array);
   }
+  BufferPool::shared().release(right_depth_array);
   if (fractional_depth_array != NULL) {
     free(fractional_depth_array);
   }
@@ -508,7 +506,7 @@ int * MandelbrotImage::makeEye(bool right, unsigned char * &fractional_depth_arr
     center_w_3d +=  (coord_t)(direction * req_eye_offset);
   }
 
-  int *depth_array_3d = (int *)malloc(req_width * req_height * sizeof(int));
+  int *depth_array_3d = (int *)BufferPool::shared().alloc(req_width * req_height * sizeof(int));
   if (smooth) {
     fractional_depth_array_3d = (unsigned char *)malloc(req_width * req_height * sizeof(unsigned char));
   }
@@ -658,8 +656,11 @@ MandelbrotImage * MandelbrotImage::make3d() {
   }
 
   // Replace depth_array w/ 3d depth array, and update calc_width/height to reflect new depth_array.
-  free(depth_array);
+  if (own_depth_array) {
+    BufferPool::shared().release(depth_array);
+  }
   depth_array = depth_array_3d;
+  own_depth_array = true;
   calc_width = req_width;
   calc_height = req_height;
   // Same for fractional_depth_array and color_array.
@@ -1502,7 +1503,7 @@ MandelbrotImage *MandelbrotImage::generateMandelbrot() {
 
   // Allocate arrays to be filled by pixelDepth().
   if (!textured || is_3d || darken || fpga) {
-    depth_array = (int *)malloc(calc_width * calc_height * sizeof(int));
+    depth_array = (int *)BufferPool::shared().alloc(calc_width * calc_height * sizeof(int));
     if (smooth) {
       fractional_depth_array = (unsigned char *)malloc(calc_width * calc_height * sizeof(unsigned char));
     }
@@ -1570,6 +1571,7 @@ MandelbrotImage *MandelbrotImage::generatePixels(int *data) {
   if (data != NULL) {
     assert(depth_array == NULL);
     depth_array = data;
+    own_depth_array = false;
   }
   if (depth_array == NULL) {
     generateMandelbrot();
@@ -1926,74 +1928,145 @@ MandelbrotImage::color_t MandelbrotImage::BLACK;
 
 // TODO: Cleanup (after this is working on FPGA).
 void HostMandelbrotApp::get_image() {
+  vector<json> params(1, socket_recv_json("image params"));
+  render_images(params);
+}
 
-  json json_obj = socket_recv_json("image params");
+void HostMandelbrotApp::get_images() {
+  json params_json = socket_recv_json("images params");
+  vector<json> params;
+  if (params_json.is_array()) {
+    for (json &p : params_json) {
+      params.push_back(p);
+    }
+  }
+  render_images(params);
+}
 
-  MandelbrotImage * mb_img_p = newMandelbrotImage(json_obj);
+void HostMandelbrotApp::render_images(vector<json> &params) {
+  vector<MandelbrotImage *> images;
+  for (json &p : params) {
+    images.push_back(newMandelbrotImage(p));
+  }
 
-  int * depth_data = NULL;
+  // Depths of images computed by the kernel (else NULL), each at an offset within depth_data.
+  vector<int *> image_data(images.size(), (int *)NULL);
 
 #ifdef KERNEL_AVAIL
-  if (mb_img_p->fpga) {
-    input_struct input;
+  int * depth_data = NULL;
+  // Until the kernel is initialized (in the background at startup), render in C++ rather than waiting.
+  vector<size_t> fpga_images;  // Indices of images computed by the kernel.
+  for (size_t i = 0; i < images.size(); i++) {
+    if (images[i]->fpga) {
+      if (kernel_ready()) {
+        fpga_images.push_back(i);
+      } else {
+        cout << "Kernel not yet ready. Rendering in C++." << endl;
+      }
+    }
+  }
+  if (!fpga_images.empty()) {
+    // The images' descriptors are batched, for one kernel launch to determine auto-depths and one to compute the images.
+    vector<input_struct> inputs;
 
     // Determine autodepth by generating a coarse-grained image for the auto-depth bounding box (using current spec_max_depth (max_depth from request)).
-    if (mb_img_p->auto_dive || mb_img_p->auto_darken) {
-      cout << "Determining depth by pre-computing small image (" << mb_img_p->auto_dive << ", " << mb_img_p->auto_darken << ")." << endl;
-      mb_img_p->setAutoDepthBounds();
-      input.width = 16;
-      input.height = 8;
-      input.coordinates[0] = mb_img_p->wToX(mb_img_p->calc_center_w - mb_img_p->auto_depth_w);
-      input.coordinates[1] = mb_img_p->hToY(mb_img_p->calc_center_h - mb_img_p->auto_depth_h);
-      input.coordinates[2] = mb_img_p->calc_pix_size * mb_img_p->auto_depth_w * 2 / (input.width - 1);
-      input.coordinates[3] = mb_img_p->calc_pix_size * mb_img_p->auto_depth_h * 2 / (input.height - 1);
-      input.max_depth = (long)(mb_img_p->spec_max_depth);
-
-      // Generate this coarse image on FPGA (allocated by handle_get_image).
+    for (size_t i : fpga_images) {
+      MandelbrotImage * mb_img_p = images[i];
+      if (mb_img_p->auto_dive || mb_img_p->auto_darken) {
+        cout << "Determining depth by pre-computing small image (" << mb_img_p->auto_dive << ", " << mb_img_p->auto_darken << ")." << endl;
+        mb_img_p->setAutoDepthBounds();
+        input_struct input = {};
+        input.width = 16;
+        input.height = 8;
+        input.coordinates[0] = mb_img_p->wToX(mb_img_p->calc_center_w - mb_img_p->auto_depth_w);
+        input.coordinates[1] = mb_img_p->hToY(mb_img_p->calc_center_h - mb_img_p->auto_depth_h);
+        input.coordinates[2] = mb_img_p->calc_pix_size * mb_img_p->auto_depth_w * 2 / (input.width - 1);
+        input.coordinates[3] = mb_img_p->calc_pix_size * mb_img_p->auto_depth_h * 2 / (input.height - 1);
+        input.max_depth = (long)(mb_img_p->spec_max_depth);
+        inputs.push_back(input);
+      } else {
+        cout << "(No auto-depth determination needed for FPGA image.)" << endl;
+      }
+    }
+    if (!inputs.empty()) {
+      // Generate these coarse images on FPGA (allocated by handle_get_image).
       // TODO: Hmmm... currently depths are modulo 256, so this approach won't work well.
-      handle_get_image(&depth_data, &input);
-
-      // Scan all depths to determine auto-depth.
-      for (int w = 0; w < input.width; w++) {
-        for (int h = 0; h < input.height; h++) {
-          mb_img_p->updateAutoDepth(depth_data[h * input.width + w], (unsigned char)0);
+      if (handle_get_image(&depth_data, inputs.data(), (int)inputs.size())) {
+        // Scan all depths to determine auto-depth.
+        int * coarse_data = depth_data;
+        for (size_t i : fpga_images) {
+          MandelbrotImage * mb_img_p = images[i];
+          if (mb_img_p->auto_dive || mb_img_p->auto_darken) {
+            for (int w = 0; w < 16; w++) {
+              for (int h = 0; h < 8; h++) {
+                mb_img_p->updateAutoDepth(coarse_data[h * 16 + w], (unsigned char)0);
+              }
+            }
+            coarse_data += 16 * 8;
+          }
         }
+        release_image(depth_data);
+        depth_data = NULL;
+      } else {
+        // Rather than respond with blank images, render in C++.
+        cout << "Kernel failed. Rendering in C++." << endl;
+        fpga_images.clear();
       }
-      free(depth_data);
-    } else {
-      cout << "(No auto-depth determination needed for FPGA image.)" << endl;
     }
 
     // Populate depth_data from FPGA.
     // X,Y are center position, and must be passed to FPGA as top left.
-    input.coordinates[0] = mb_img_p->wToX(0);
-    input.coordinates[1] = mb_img_p->hToY(0);
-    input.coordinates[2] = mb_img_p->calc_pix_size;
-    input.coordinates[3] = mb_img_p->calc_pix_size;
-    input.width  = (long)(mb_img_p->getDepthArrayWidth());
-    input.height = (long)(mb_img_p->getDepthArrayHeight());
-    input.max_depth = (long)(mb_img_p->spec_max_depth);  // may have been changed based on auto-depth.
-
-    handle_get_image(&depth_data, &input);
+    inputs.clear();
+    for (size_t i : fpga_images) {
+      MandelbrotImage * mb_img_p = images[i];
+      input_struct input = {};
+      input.coordinates[0] = mb_img_p->wToX(0);
+      input.coordinates[1] = mb_img_p->hToY(0);
+      input.coordinates[2] = mb_img_p->calc_pix_size;
+      input.coordinates[3] = mb_img_p->calc_pix_size;
+      input.width  = (long)(mb_img_p->getDepthArrayWidth());
+      input.height = (long)(mb_img_p->getDepthArrayHeight());
+      input.max_depth = (long)(mb_img_p->spec_max_depth);  // may have been changed based on auto-depth.
+      inputs.push_back(input);
+    }
 
-    // TODO: Cut-n-paste.
-    // Max depth is no longer speculative.
-    mb_img_p->max_depth = mb_img_p->spec_max_depth;
-    // Darkening for depth can only be applied once auto-depth is computed (which it now is).
-    mb_img_p->darkenDepthArray();
+    if (!fpga_images.empty() && !handle_get_image(&depth_data, inputs.data(), (int)inputs.size())) {
+      // Rather than respond with blank images, render in C++.
+      cout << "Kernel failed. Rendering in C++." << endl;
+      fpga_images.clear();
+    }
 
+    int * next_data = depth_data;
+    for (size_t n = 0; n < fpga_images.size(); n++) {
+      MandelbrotImage * mb_img_p = images[fpga_images[n]];
+      image_data[fpga_images[n]] = next_data;
+      next_data += inputs[n].width * inputs[n].height;
+
+      // TODO: Cut-n-paste.
+      // Max depth is no longer speculative.
+      mb_img_p->max_depth = mb_img_p->spec_max_depth;
+      // Darkening for depth can only be applied once auto-depth is computed (which it now is).
+      mb_img_p->darkenDepthArray();
+    }
   }
 #endif
 
-  mb_img_p->generatePixels(depth_data);  // Note that depth_array is from FPGA for OpenCL (and given here to mb_img to free), or NULL to generate in C++.
+  for (size_t i = 0; i < images.size(); i++) {
+    images[i]->generatePixels(image_data[i]);  // Note that image data is from FPGA for OpenCL (and released below), or NULL to generate in C++.
 
-  size_t png_size;
-  unsigned char *png;
-  png = mb_img_p->generatePNG(&png_size);
+    size_t png_size;
+    unsigned char *png;
+    png = images[i]->generatePNG(&png_size);
 
-  //cout << "C++ Image Generated" << endl;
+    //cout << "C++ Image Generated" << endl;
 
-  // Call the utility function to send data over the socket
-  handle_read_data(png, (int)png_size);
-  delete mb_img_p;
+    // Call the utility function to send data over the socket
+    handle_read_data(png, (int)png_size);
+    delete images[i];
+  }
+#ifdef KERNEL_AVAIL
+  if (depth_data != NULL) {
+    release_image(depth_data);
+  }
+#endif
 }
@@ -150,7 +150,7 @@ public:
   
   // Generate pixel color data according to the color scheme from a [width][height] array of pixel depths.
   // The depths array can be:
-  //   - provided as an argument
+  //   - provided as an argument (in which case it remains owned by the caller, and must outlive this image)
   //   - have been produced already
   //   - be generated automatically if necessary, internal to this method (via generateMandelbrot())
   MandelbrotImage * generatePixels(int *data = NULL);
@@ -358,7 +358,8 @@ protected:
   coord_t exp2; // Experimental too
 
   // Storage structures. These are freed upon destruction.
-  int *depth_array;  // Image array of depth integers.
+  int *depth_array;  // Image array of depth integers. (Depth arrays are allocated from BufferPool::shared().)
+  bool own_depth_array;  // False if depth_array was provided to generatePixels(), in which case it is not freed.
   unsigned char *fractional_depth_array; // A fractional depth for smoothing. This value / 256 is added to depth (giving the ratio of depth color to depth+1 color).
   color_t *color_array;  // Colors for the image (corresponding to depth_array), used when depth alone is not enough to determine color. (These are later packed into an image.)
   int *right_depth_array; // For stereo images, depth_array is the left eye and this is the right. 
@@ -451,9 +452,17 @@ inline void MandelbrotImage::updateAutoDepth(int w1, int h1, int w2, int h2, int
 // ---------------------------------------------------------------------------------------------------------
 class HostMandelbrotApp : public HostApp {
 
+protected:
+  /*
+  ** Render the images of the given GET_IMAGE parameters, computing those rendered by the kernel together, and send
+  ** each, in order.
+  */
+  void render_images(vector<json> &params);
+
 public:
 
   void get_image();
+  void get_images();
   virtual MandelbrotImage * newMandelbrotImage(json &params) {return new MandelbrotImage(params);} // Can be extented to utilize a derived type.
 };
 
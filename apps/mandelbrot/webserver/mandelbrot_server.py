@@ -35,6 +35,7 @@ import sys
 import os
 import signal
 import re
+import tornado.concurrent
 sys.path.append(os.path.abspath(os.path.dirname(__file__) + '/../../../framework/webserver'))
 from server import *
 import unicodedata
@@ -128,7 +129,7 @@ class ImageHandler(tornado.web.RequestHandler):
         return re.match("^\w+$", dir)
 
     # handles image request via get request
-    def get(self, type, depth=u'1000', tile_z=None, tile_x=None, tile_y=None):
+    async def get(self, type, depth=u'1000', tile_z=None, tile_x=None, tile_y=None):
 
         json_str = self.get_query_argument("json", False)
 
@@ -184,7 +185,7 @@ class ImageHandler(tornado.web.RequestHandler):
         else:
             print("Unrecognized type arg in ImageHandler.get(..)")
 
-        img_data = self.application.renderImage(json_str, json_obj)
+        img_data = await self.application.renderImageBatched(json_str, json_obj)
         self.write(img_data)
 
 
@@ -316,6 +317,8 @@ class MandelbrotApplication(FPGAServerApplication):
               (r"/(?P<type>\w*tile)/(?P<depth>[^\/]+)/(?P<tile_z>[^\/]+)/?(?P<tile_x>[^\/]+)?/?(?P<tile_y>[^\/]+)?", ImageHandler),
             ])
         super(MandelbrotApplication, self).__init__(routes, args)
+        # Image requests for the host that are awaiting renderPendingImages(), as (settings string, Future).
+        self.pending_images = []
         
     
     """
@@ -336,6 +339,31 @@ class MandelbrotApplication(FPGAServerApplication):
             img_data = get_image(self.socket, GET_IMAGE, settings_str, False)
         return img_data
 
+    """
+    As renderImage, but returning a Future. Requests for the host that arrive together (e.g. the tiles of a view) are
+    batched into a single GET_IMAGES, which the host computes with one kernel launch.
+    """
+    def renderImageBatched(self, settings_str, settings):
+        future = tornado.concurrent.Future()
+        if self.socket == None or settings["renderer"] == "python":
+            future.set_result(self.renderImage(settings_str, settings))
+        else:
+            if not self.pending_images:
+                # Render once the requests that have already arrived are queued.
+                tornado.ioloop.IOLoop.current().add_callback(self.renderPendingImages)
+            self.pending_images.append((settings_str, future))
+        return future
+
+    def renderPendingImages(self):
+        pending = self.pending_images
+        self.pending_images = []
+        if len(pending) == 1:
+            pending[0][1].set_result(get_image(self.socket, GET_IMAGE, pending[0][0], False))
+        else:
+            images = get_images(self.socket, GET_IMAGES, [settings_str for (settings_str, future) in pending], False)
+            for ((settings_str, future), img_data) in zip(pending, images):
+                future.set_result(img_data)
+
 if __name__ == "__main__":
 
     # Command-line options
@@ -1,7 +1,7 @@
 /*
 BSD 3-Clause License
 
-Copyright (c) 2018, Steven F. Hoover
+Copyright (c) 2019, Steven F. Hoover
 All rights reserved.
 
 Redistribution and use in source and binary forms, with or without
@@ -32,43 +32,53 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /*
 **
-** The main application that is needed to communicate with the hardware and the
-** python server.
+** A software model of the vadd kernel (see fpga/src/vadd_kernel.sv) for the sw build target.
+** Each 32-bit input value is incremented. Like the RTL, there is no buffering, so an output must be
+** taken before the next input is accepted.
 **
-** It accepts socket communications to transmit data and commands.
-** The access to the hardware resources is possible through the use of a library
-** "kernel.c" which contains all the functions that are needed to utilize the FPGA device.
-**
-** There is a set of functions that handle the communication through the socket.
-**
-** Author: Alessandro Comodi, Politecnico di Milano
-**
-** TODO: There's still a lot of image-specific content here. Partition cleanly.
 */
 
-// THIS CODE NOT YET ENABLED
-ERROR
-
-#ifndef VADD_H
-#define VADD_H
-
-#include <string>
-#include <time.h>
+#include <string.h>
+#include "sw_model.h"
 
-#include "server_main.h"
 
-using namespace std;
-
-
-
-// ---------------------------------------------------------------------------------------------------------
-class HostVAddApp : public HostApp {
-
-public:
-  // Without OpenCL, define fake vadd kernel behavior for testing the client.
-  // Othersize, default passthrough behavior is fine.
-  void fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer);
+struct vadd_model {
+  bool avail;  // An output word is available.
+  uint32_t data[SW_MODEL_DATA_WORDS];
 };
 
-
-#endif
+void * sw_model_create() {
+  vadd_model * m = new vadd_model;
+  sw_model_reset(m);
+  return m;
+}
+
+void sw_model_destroy(void * model) {
+  delete (vadd_model *)model;
+}
+
+void sw_model_reset(void * model) {
+  ((vadd_model *)model)->avail = false;
+}
+
+int sw_model_in(void * model, const uint32_t in_data[SW_MODEL_DATA_WORDS]) {
+  vadd_model * m = (vadd_model *)model;
+  if (m->avail) {
+    return 0;
+  }
+  for (int i = 0; i < SW_MODEL_DATA_WORDS; i++) {
+    m->data[i] = in_data[i] + 1;
+  }
+  m->avail = true;
+  return 1;
+}
+
+int sw_model_out(void * model, uint32_t out_data[SW_MODEL_DATA_WORDS]) {
+  vadd_model * m = (vadd_model *)model;
+  if (!m->avail) {
+    return 0;
+  }
+  memcpy(out_data, m->data, sizeof(m->data));
+  m->avail = false;
+  return 1;
+}
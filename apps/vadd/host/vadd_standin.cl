@@ -1,7 +1,7 @@
 /*
 BSD 3-Clause License
 
-Copyright (c) 2018, Steven F. Hoover
+Copyright (c) 2019, Steven F. Hoover
 All rights reserved.
 
 Redistribution and use in source and binary forms, with or without
@@ -30,35 +30,20 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+
 /*
 **
-** The main application that is needed to communicate with the hardware and the
-** python server.
-**
-** It accepts socket communications to transmit data and commands.
-** The access to the hardware resources is possible through the use of a library
-** "kernel.c" which contains all the functions that are needed to utilize the FPGA device.
-**
-** There is a set of functions that handle the communication through the socket.
-**
-** Author: Alessandro Comodi, Politecnico di Milano
+** An OpenCL C equivalent of the vadd kernel (see fpga/src/vadd_kernel.sv), for running the hw host application on a
+** stand-in OpenCL platform without an FPGA (see the "standin_host" target of framework/build/Makefile). The host
+** builds this source in place of an FPGA image.
+** Each 32-bit input value is incremented. Arguments are as passed by HW_Kernel::start_kernel(), which runs a single
+** work-item.
 **
 */
 
-
-#include <cstdlib>
-
-
-void HostApp::fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer) {
-  if (bytes_out != bytes_in) {
-    cerr_line() << "VAdd fakeServer expects bytes_out (" << bytes_out << ") == bytes_in (" << bytes_in << "). Exiting." << endl;
-    exit(1);
-  }
-  if (bytes_in & 0x3) {
-    cerr_line() << "VAdd fakeKernel expects uint32's, but received " << bytes_in << " bytes." << endl;
-  }
-  
-  for (int i = 0, uint32 * in = (uint32 *)in_buffer, uint32 * out = (uint32 *)out_buffer; i < bytes_in >> 2; i++, in++, out++) {
-    *out = *in + 1;
+__kernel void vadd(uint data_size, uint resp_size, __global const uint * in, __global uint * out) {
+  uint words = min(data_size, resp_size) / 4;
+  for (uint i = 0; i < words; i++) {
+    out[i] = in[i] + 1;
   }
 }
@@ -197,22 +197,107 @@ class fpgaServer {
     this.ws.send(JSON.stringify({ "type": "STOP_TRACING", payload: {} }));
   }
 
+  // Save the kernel context of this connection's session as the host's checkpoint, from which the host starts next
+  // time (if it was launched with one, for the sim target).
+  saveCheckpoint() {
+    this.ws.send(JSON.stringify({ "type": "SAVE_CHECKPOINT", payload: {} }));
+  }
+
+  // Load a program image (or other data) directly into a memory of the kernel, for simulated kernels whose memory is
+  // declared public. This is much faster than streaming it through the kernel's input.
+  // Args:
+  //   - memory: The hierarchical name of the memory within the kernel, e.g. "core.imem".
+  //   - address: The index of the first entry to write.
+  //   - entries: An array with a value per entry: a number (up to 53 bits in JavaScript), or an array of 32-bit values,
+  //              least-significant first.
+  // The response is {type: "LOAD_MEMORY", entries: <count>} or {type: "LOAD_MEMORY", error: <message>}.
+  loadMemory(memory, address, entries) {
+    this.ws.send(JSON.stringify({ "type": "LOAD_MEMORY", payload: {memory: memory, address: address, data: entries} }));
+  }
+
+  // Request host statistics. The response is {type: "STATS", stats: {...}}.
+  getStats() {
+    this.ws.send(JSON.stringify({ "type": "STATS", payload: {} }));
+  }
+
   // This is the API currently exposed for sending data.
   // Args:
-  //   - resp_size: The number of chunks that must be returned in response. (The need to provide this is an artifact of the current implementation.)
+  //   - resp_size: The maximum number of chunks to be returned in response. For kernels that mark the end of their response (out_last),
+  //                this can be null, and the response size is determined by the kernel. Otherwise, exactly this number is returned.
   //   - chunks: An array of arrays of up to 16 32-bit signed or unsigned integer values. Chunks with fewer than 16 values will be padded w/ 0 values.
-  sendChunks(resp_size, chunks) {
+  //   - stream_batch: (opt) If given, the response is streamed as it is produced, as messages of up to this many chunks each,
+  //                   followed by a {type: "STREAM_DATA_MSG", done: true} message.
+  //   - perf: (opt) If true (and not streaming), the response is {data: [...], perf: {...}}, where perf holds the kernel's
+  //           performance counters for the request (for the sim target: cycles, in_stall_cycles, out_bubble_cycles, seconds).
+  sendChunks(resp_size, chunks, stream_batch, perf) {
     chunks.forEach( (el) => {
       // Pad the chunks.
       for (let i = el.length; i < 16; i++) {
         el[i] = 0;
       };
     })
-    this.send("DATA_MSG", JSON.stringify({
+    let payload = {
+          size: chunks.length,
+          data: chunks
+    };
+    if (resp_size !== null && typeof resp_size !== "undefined") {
+      payload.resp_size = resp_size;
+    }
+    if (typeof stream_batch !== "undefined") {
+      payload.batch = stream_batch;
+    }
+    if (perf) {
+      payload.perf = true;
+    }
+    this.send((typeof stream_batch === "undefined") ? "DATA_MSG" : "STREAM_DATA_MSG", JSON.stringify(payload));
+  }
+
+  // As sendChunks(..) (without streaming the response), but the web server forwards the chunks to the host in pieces,
+  // which the host feeds to the kernel as they are received, rather than once the whole message is. (This message
+  // itself still reaches the web server whole, so only the web server's hop to the host is streamed.)
+  uploadChunks(resp_size, chunks, perf) {
+    chunks.forEach( (el) => {
+      for (let i = el.length; i < 16; i++) {
+        el[i] = 0;
+      };
+    })
+    let payload = {
           size: chunks.length,
-          resp_size: resp_size,
           data: chunks
-    }));
+    };
+    if (resp_size !== null && typeof resp_size !== "undefined") {
+      payload.resp_size = resp_size;
+    }
+    if (perf) {
+      payload.perf = true;
+    }
+    this.send("UPLOAD_DATA_MSG", JSON.stringify(payload));
+  }
+
+  // Send many independent jobs in a single DATA_MSG, to amortize per-message overhead. The host runs them back to back
+  // and responds with an array of their responses, in order.
+  // Args:
+  //   - jobs: An array of {resp_size, chunks}, as for sendChunks(..). Each job is its own kernel transaction.
+  //   - perf: (opt) As for sendChunks(..).
+  sendJobs(jobs, perf) {
+    let payload = {
+      jobs: jobs.map( (job) => {
+        job.chunks.forEach( (el) => {
+          for (let i = el.length; i < 16; i++) {
+            el[i] = 0;
+          };
+        })
+        let ret = {size: job.chunks.length, data: job.chunks};
+        if (job.resp_size !== null && typeof job.resp_size !== "undefined") {
+          ret.resp_size = job.resp_size;
+        }
+        return ret;
+      })
+    };
+    if (perf) {
+      payload.perf = true;
+    }
+    this.send("DATA_MSG", JSON.stringify(payload));
   }
 
 
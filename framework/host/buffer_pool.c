@@ -0,0 +1,177 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A pool of aligned I/O buffers for the kernel data path (see buffer_pool.h).
+**
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <iostream>
+#include "buffer_pool.h"
+
+using namespace std;
+
+
+// Precedes each buffer, padded to ALIGNMENT.
+struct BufferPool::Header {
+  static const uint32_t MAGIC = 0xB0FFE125;
+  uint32_t magic;
+  int size_class;  // Index of free_lists, or -1 if not pooled.
+  size_t bytes;    // Allocated bytes, including the header.
+  bool mapped;     // Allocated by mmap(..), rather than posix_memalign(..).
+};
+
+BufferPool::BufferPool() {
+  static_assert(sizeof(Header) <= ALIGNMENT, "BufferPool::Header exceeds alignment.");
+}
+
+BufferPool::~BufferPool() {
+  trim();
+}
+
+BufferPool &BufferPool::shared() {
+  static BufferPool pool;
+  return pool;
+}
+
+int BufferPool::size_class(size_t bytes) {
+  size_t class_bytes = MIN_CLASS_BYTES;
+  for (int cls = 0; cls < NUM_CLASSES; cls++) {
+    if (bytes <= class_bytes) {
+      return cls;
+    }
+    class_bytes <<= 1;
+  }
+  return -1;
+}
+
+void * BufferPool::alloc(size_t bytes) {
+  size_t total = bytes + ALIGNMENT;
+  int cls = size_class(total);
+  if (cls >= 0) {
+    {
+      lock_guard<std::mutex> lock(mutex);
+      if (!free_lists[cls].empty()) {
+        void * buffer = free_lists[cls].back();
+        free_lists[cls].pop_back();
+        size_t bytes = ((Header *)((char *)buffer - ALIGNMENT))->bytes;
+        if (bytes >= HUGE_PAGE_BYTES) {free_large_bytes -= bytes;}
+        hits++;
+        return buffer;
+      }
+      misses++;
+    }
+    total = MIN_CLASS_BYTES << cls;
+  } else {
+    lock_guard<std::mutex> lock(mutex);
+    misses++;
+  }
+
+  void * base = NULL;
+  bool mapped = false;
+  if (huge_pages && total >= HUGE_PAGE_BYTES) {
+    total = (total + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    #ifdef MAP_HUGETLB
+    base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    #else
+    base = MAP_FAILED;
+    #endif
+    if (base == MAP_FAILED) {
+      // No reserved huge pages. Use transparent huge pages, if available.
+      base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      #ifdef MADV_HUGEPAGE
+      if (base != MAP_FAILED) {madvise(base, total, MADV_HUGEPAGE);}
+      #endif
+    }
+    if (base == MAP_FAILED) {
+      base = NULL;
+    } else {
+      mapped = true;
+    }
+  }
+  if (base == NULL && posix_memalign(&base, 4096, total) != 0) {
+    cerr << "BufferPool: Failed to allocate " << total << " bytes." << endl;
+    return NULL;
+  }
+
+  Header * header = (Header *)base;
+  header->magic = Header::MAGIC;
+  header->size_class = cls;
+  header->bytes = total;
+  header->mapped = mapped;
+  return (char *)base + ALIGNMENT;
+}
+
+void BufferPool::release(void * buffer) {
+  if (buffer == NULL) {
+    return;
+  }
+  Header * header = (Header *)((char *)buffer - ALIGNMENT);
+  assert(header->magic == Header::MAGIC);
+  if (header->size_class >= 0) {
+    lock_guard<std::mutex> lock(mutex);
+    // (Large buffers are retained only within their byte budget, so a few large requests do not pin gigabytes.)
+    bool large = header->bytes >= HUGE_PAGE_BYTES;
+    if ((int)free_lists[header->size_class].size() < MAX_FREE_PER_CLASS &&
+        (!large || free_large_bytes + header->bytes <= MAX_FREE_LARGE_BYTES)) {
+      free_lists[header->size_class].push_back(buffer);
+      if (large) {free_large_bytes += header->bytes;}
+      return;
+    }
+  }
+  free_raw(header);
+}
+
+void BufferPool::trim() {
+  lock_guard<std::mutex> lock(mutex);
+  for (int cls = 0; cls < NUM_CLASSES; cls++) {
+    for (void * buffer : free_lists[cls]) {
+      free_raw((Header *)((char *)buffer - ALIGNMENT));
+    }
+    free_lists[cls].clear();
+  }
+  free_large_bytes = 0;
+}
+
+void BufferPool::free_raw(Header * header) {
+  header->magic = 0;
+  if (header->mapped) {
+    munmap(header, header->bytes);
+  } else {
+    free(header);
+  }
+}
@@ -0,0 +1,113 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A pool of aligned I/O buffers for the kernel data path, shared by HostApp and all Kernel backends.
+**
+** Buffers are recycled in power-of-two size classes, so, in steady state, requests are served without
+** touching the system allocator. Buffers are 64-byte (DATA_WIDTH_BYTES) aligned. Large buffers can
+** optionally be backed by huge pages (explicitly reserved, if available, else transparent).
+**
+** Buffers must be returned with release(..) (not free(..)).
+**
+*/
+
+#ifndef HEADER_BUFFER_POOL
+#define HEADER_BUFFER_POOL
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+
+class BufferPool {
+
+public:
+  static const size_t ALIGNMENT = 64;               // Alignment of buffers (and size of the hidden header).
+  static const size_t MIN_CLASS_BYTES = 1 << 10;    // Size of the smallest size class (including the header).
+  static const int NUM_CLASSES = 21;                // Size classes up to 1GB. Larger buffers are not pooled.
+  static const int MAX_FREE_PER_CLASS = 8;          // Free buffers retained per size class.
+  static const size_t HUGE_PAGE_BYTES = 2 << 20;    // Buffers of at least this size may use huge pages.
+  static const size_t MAX_FREE_LARGE_BYTES = 1 << 30;  // Free bytes retained in total in classes of HUGE_PAGE_BYTES and up.
+
+  BufferPool();
+  ~BufferPool();
+
+  /*
+  ** The pool used by HostApp and the Kernel backends.
+  */
+  static BufferPool &shared();
+
+  /*
+  ** Back buffers of at least HUGE_PAGE_BYTES with huge pages (applies to subsequent allocations).
+  */
+  void set_huge_pages(bool huge_pages) {this->huge_pages = huge_pages;}
+
+  /*
+  ** Allocate a buffer of at least bytes bytes, reusing a free buffer of the same size class if possible.
+  ** Returns NULL on failure.
+  */
+  void * alloc(size_t bytes);
+  /*
+  ** Return a buffer from alloc(..) to the pool. NULL is ignored.
+  */
+  void release(void * buffer);
+  /*
+  ** Free all pooled (free) buffers.
+  */
+  void trim();
+
+  // Counts of allocations served from the pool and from the system.
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+private:
+  struct Header;
+
+  bool huge_pages = false;
+  std::vector<void *> free_lists[NUM_CLASSES];
+  size_t free_large_bytes = 0;  // Bytes of free buffers of HUGE_PAGE_BYTES and up.
+  std::mutex mutex;
+
+  /*
+  ** The size class for an allocation of bytes (including header), or -1 if too large to pool.
+  */
+  static int size_class(size_t bytes);
+  /*
+  ** Release memory to the system.
+  */
+  static void free_raw(Header * header);
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A benchmark of DATA_MSG JSON handling, comparing DataMsgJson with general (nlohmann) JSON parsing and serialization.
+** Build and run with "make data_msg_bench".
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include "data_msg_json.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char const *argv[]) {
+  int words = (argc > 1) ? atoi(argv[1]) : 65536;
+  int reps = (argc > 2) ? atoi(argv[2]) : 10;
+  const int VALUES = DataMsgJson::WORD_VALUES;
+
+  // Random data, and the corresponding message.
+  uint32_t * data = (uint32_t *)malloc(words * VALUES * sizeof(uint32_t));
+  uint32_t * parsed = (uint32_t *)malloc(words * VALUES * sizeof(uint32_t));
+  for (int i = 0; i < words * VALUES; i++) {
+    data[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+  }
+  string msg = "{\"size\": " + to_string(words) + ", \"resp_size\": " + to_string(words) + ", \"data\": ";
+  DataMsgJson::append_json(msg, data, words);
+  msg += "}";
+  printf("%d words (%lu-byte message), %d repetitions\n", words, msg.size(), reps);
+
+  auto report = [words, reps](const char * what, double secs) {
+    printf("  %-30s %8.3f ms  %12.0f words/s\n", what, secs * 1000.0 / reps, (double)words * reps / secs);
+  };
+
+  // Parse.
+  auto start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    json msg_json = json::parse(msg);
+    const json &data_json = msg_json["data"];
+    for (int w = 0; w < words; w++) {
+      for (int i = 0; i < VALUES; i++) {
+        parsed[w * VALUES + i] = data_json[w][i];
+      }
+    }
+  }
+  report("parse (general)", seconds_since(start));
+  start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    DataMsgJson fields;
+    if (!fields.parse_header(msg.c_str()) || !fields.parse_data(parsed)) {
+      fprintf(stderr, "DataMsgJson failed to parse the message.\n");
+      return 1;
+    }
+  }
+  report("parse (DataMsgJson)", seconds_since(start));
+  for (int i = 0; i < words * VALUES; i++) {
+    if (parsed[i] != data[i]) {
+      fprintf(stderr, "Mismatch at value %d.\n", i);
+      return 1;
+    }
+  }
+
+  // Serialize.
+  size_t len = 0;
+  start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    string s("[");
+    for (int w = 0; w < words; w++) {
+      if (w > 0) {s += ",";}
+      s += "[";
+      for (int i = 0; i < VALUES; i++) {
+        if (i > 0) {s += ",";}
+        s += to_string(data[w * VALUES + i]);
+      }
+      s += "]";
+    }
+    s += "]";
+    len += s.size();
+  }
+  report("serialize (to_string)", seconds_since(start));
+  start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    string s;
+    DataMsgJson::append_json(s, data, words);
+    len -= s.size();
+  }
+  report("serialize (DataMsgJson)", seconds_since(start));
+  if (len != 0) {
+    fprintf(stderr, "Serializations differ in length.\n");
+    return 1;
+  }
+
+  free(data);
+  free(parsed);
+  return 0;
+}
@@ -0,0 +1,220 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A parser and serializer specialized for DATA_MSG JSON (see data_msg_json.h).
+**
+*/
+
+#include <string.h>
+#include <limits.h>
+#include "data_msg_json.h"
+
+using namespace std;
+
+
+bool DataMsgJson::parse_header(const char * msg) {
+  p = msg;
+  return expect('{') && parse_members(true) && size >= 0;
+}
+
+bool DataMsgJson::parse_data(uint32_t * data) {
+  if (!expect('[')) {return false;}
+  for (long d = 0; d < size; d++) {
+    if ((d > 0 && !expect(',')) || !expect('[')) {return false;}
+    for (int i = 0; i < WORD_VALUES; i++) {
+      int64_t value;
+      if ((i > 0 && !expect(',')) || !parse_integer(value)) {return false;}
+      // (Negative values are taken as signed 32-bit values.)
+      data[d * WORD_VALUES + i] = (uint32_t)value;
+    }
+    if (!expect(']')) {return false;}
+  }
+  if (!expect(']') || !parse_members(false)) {return false;}
+  skip_ws();
+  return *p == '\0';
+}
+
+void DataMsgJson::read_fields(const nlohmann::json &msg) {
+  size = field(msg, "size");
+  resp_size = field(msg, "resp_size");
+  batch = field(msg, "batch");
+  perf = msg.count("perf") && (bool)msg["perf"];
+}
+
+long DataMsgJson::field(const nlohmann::json &msg, const char * name) {
+  if (!msg.count(name)) {
+    return ABSENT;
+  }
+  const nlohmann::json &value = msg[name];
+  if (value.is_number_unsigned()) {
+    return value.get<uint64_t>() <= (uint64_t)LONG_MAX ? (long)value.get<uint64_t>() : INVALID;
+  }
+  if (value.is_number_float()) {
+    // (Integral values only, e.g. 2.0.)
+    double d = value.get<double>();
+    return d >= 0.0 && d < (double)LONG_MAX && d == (double)(long)d ? (long)d : INVALID;
+  }
+  return value.is_number_integer() && value.get<int64_t>() >= 0 ? (long)value.get<int64_t>() : INVALID;
+}
+
+bool DataMsgJson::parse_members(bool to_data) {
+  // (Resuming after "data", each remaining member follows a comma.)
+  bool comma = !to_data;
+  while (true) {
+    skip_ws();
+    if (*p == '}') {p++; return !to_data;}
+    if (comma && !expect(',')) {return false;}
+    comma = true;
+    const char * name;
+    size_t len;
+    if (!parse_name(name, len) || !expect(':')) {return false;}
+    #define NAME_IS(str) (len == sizeof(str) - 1 && !strncmp(name, str, len))
+    if (NAME_IS("data")) {
+      // (The data must follow the size, so it can be placed directly.)
+      return to_data && size >= 0;
+    }
+    int64_t value;
+    if (NAME_IS("size") || NAME_IS("resp_size") || NAME_IS("batch")) {
+      if (!parse_integer(value)) {return false;}
+      (NAME_IS("size") ? size : NAME_IS("resp_size") ? resp_size : batch) = value >= 0 ? (long)value : INVALID;
+    } else if (NAME_IS("perf")) {
+      skip_ws();
+      if (!strncmp(p, "true", 4)) {perf = true; p += 4;}
+      else if (!strncmp(p, "false", 5)) {perf = false; p += 5;}
+      else {return false;}
+    } else if (NAME_IS("jobs")) {
+      return false;
+    } else if (!skip_value()) {
+      return false;
+    }
+    #undef NAME_IS
+  }
+}
+
+bool DataMsgJson::parse_name(const char * &name, size_t &len) {
+  if (!expect('"')) {return false;}
+  name = p;
+  while (*p != '"') {
+    if (*p == '\\' || *p == '\0') {return false;}
+    p++;
+  }
+  len = p - name;
+  p++;
+  return true;
+}
+
+bool DataMsgJson::parse_integer(int64_t &value) {
+  skip_ws();
+  bool neg = *p == '-';
+  if (neg) {p++;}
+  if (*p < '0' || *p > '9') {return false;}
+  uint64_t v = 0;
+  const char * start = p;
+  while (*p >= '0' && *p <= '9') {
+    v = v * 10 + (*p++ - '0');
+  }
+  // Fractions, exponents, and numbers beyond 64 bits are left to the general parser.
+  if (*p == '.' || *p == 'e' || *p == 'E' || p - start > 18) {return false;}
+  value = neg ? -(int64_t)v : (int64_t)v;
+  return true;
+}
+
+bool DataMsgJson::skip_value() {
+  skip_ws();
+  const char * start = p;
+  int depth = 0;
+  for (; *p != '\0'; p++) {
+    if (*p == '"') {
+      for (p++; *p != '"'; p++) {
+        if (*p == '\0') {return false;}
+        if (*p == '\\' && p[1] != '\0') {p++;}
+      }
+    } else if (*p == '[' || *p == '{') {
+      depth++;
+    } else if (*p == ']' || *p == '}') {
+      if (depth == 0) {break;}
+      depth--;
+    } else if (*p == ',' && depth == 0) {
+      break;
+    }
+  }
+  return p > start && *p != '\0';
+}
+
+// Digits generated two at a time.
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline char * write_uint32(char * out, uint32_t value) {
+  char buf[10];
+  char * end = buf + sizeof(buf);
+  char * b = end;
+  while (value >= 100) {
+    const char * pair = &DIGIT_PAIRS[(value % 100) * 2];
+    value /= 100;
+    b -= 2;
+    b[0] = pair[0];
+    b[1] = pair[1];
+  }
+  if (value >= 10) {
+    b -= 2;
+    b[0] = DIGIT_PAIRS[value * 2];
+    b[1] = DIGIT_PAIRS[value * 2 + 1];
+  } else {
+    *--b = '0' + value;
+  }
+  memcpy(out, b, end - b);
+  return out + (end - b);
+}
+
+void DataMsgJson::append_json(string &s, const uint32_t * data, int data_words) {
+  // Size for the longest representation (10 digits and a comma per value, and brackets), then trim.
+  size_t start = s.size();
+  s.resize(start + 2 + (size_t)data_words * (WORD_VALUES * 11 + 3));
+  char * out = &s[start];
+  *out++ = '[';
+  for (int d = 0; d < data_words; d++) {
+    if (d > 0) {*out++ = ',';}
+    *out++ = '[';
+    for (int i = 0; i < WORD_VALUES; i++) {
+      if (i > 0) {*out++ = ',';}
+      out = write_uint32(out, data[d * WORD_VALUES + i]);
+    }
+    *out++ = ']';
+  }
+  *out++ = ']';
+  s.resize(out - &s[0]);
+}
@@ -0,0 +1,101 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A parser and serializer specialized for DATA_MSG JSON, whose data is an array of 512-bit words, each an array of
+** 16 32-bit values. The parser writes the words directly into a (kernel input) buffer, without building a JSON DOM, and
+** the serializer generates digits directly into a string of sufficient capacity. Messages of any other shape are
+** left to a general JSON parser.
+**
+*/
+
+#ifndef HEADER_DATA_MSG_JSON
+#define HEADER_DATA_MSG_JSON
+
+#include <stdint.h>
+#include <string>
+#include <nlohmann/json.hpp>
+
+
+class DataMsgJson {
+
+public:
+  static const int WORD_VALUES = 16;  // 32-bit values per word.
+
+  // Fields of the message (ABSENT, or INVALID if not a non-negative integer).
+  static const long ABSENT = -1;
+  static const long INVALID = -2;
+  long size = ABSENT;
+  long resp_size = ABSENT;
+  long batch = ABSENT;
+  bool perf = false;
+
+  /*
+  ** Parse msg (which must remain unchanged until parsing is complete) up to its "data", which must follow "size".
+  ** Known fields are "size", "resp_size", "batch", and "perf". Other fields are ignored, except "jobs".
+  ** Returns false if msg is not of this form (or uses JSON features this parser does not, such as escapes in names or
+  ** non-integer numbers), in which case it should be parsed generally.
+  */
+  bool parse_header(const char * msg);
+  /*
+  ** Following parse_header(..), parse the size words of data into data, and the remainder of the message. Returns false
+  ** if the data is not exactly size words of 16 integers, or the message is otherwise not of the expected form.
+  */
+  bool parse_data(uint32_t * data);
+  /*
+  ** Take the fields from a message parsed generally.
+  */
+  void read_fields(const nlohmann::json &msg);
+  /*
+  ** The value of the given field of a message parsed generally, as for the fields above.
+  */
+  static long field(const nlohmann::json &msg, const char * name);
+
+  /*
+  ** Append data_words words of data to s, as a JSON array of 16-element arrays.
+  */
+  static void append_json(std::string &s, const uint32_t * data, int data_words);
+
+private:
+  const char * p = NULL;  // Parse position.
+
+  void skip_ws() {while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') {p++;}}
+  bool expect(char c) {skip_ws(); if (*p != c) {return false;} p++; return true;}
+  bool parse_name(const char * &name, size_t &len);
+  bool parse_integer(int64_t &value);
+  bool skip_value();
+  // Parse members through the closing brace, or, if to_data, through the name of "data".
+  bool parse_members(bool to_data);
+};
+
+#endif
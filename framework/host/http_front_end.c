@@ -0,0 +1,660 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** An HTTP/1.1 and WebSocket front end for HostApp (see http_front_end.h).
+**
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <functional>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "http_front_end.h"
+
+using namespace std;
+
+
+/*
+** A local channel delivering each message of a command's response to forward(..), if given, or collecting them.
+*/
+class LocalResponse : public HostApp::LocalChannel {
+public:
+  vector<string> messages;
+  function<void(const char *, uint32_t)> forward;
+protected:
+  void message(const char * data, uint32_t len) {
+    if (forward) {
+      forward(data, len);
+    } else {
+      messages.emplace_back(data, len);
+    }
+  }
+};
+
+
+// SHA-1 digest (for the WebSocket handshake).
+static string sha1(const string &s) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  string m = s;
+  m += (char)0x80;
+  while (m.length() % 64 != 56) {m += (char)0;}
+  uint64_t bits = (uint64_t)s.length() * 8;
+  for (int i = 7; i >= 0; i--) {m += (char)(bits >> (i * 8));}
+  auto rol = [](uint32_t x, int n) {return (x << n) | (x >> (32 - n));};
+  for (size_t chunk = 0; chunk < m.length(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const unsigned char * p = (const unsigned char *)&m[chunk + i * 4];
+      w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    for (int i = 16; i < 80; i++) {w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);}
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20)      {f = (b & c) | (~b & d);          k = 0x5A827999;}
+      else if (i < 40) {f = b ^ c ^ d;                   k = 0x6ED9EBA1;}
+      else if (i < 60) {f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC;}
+      else             {f = b ^ c ^ d;                   k = 0xCA62C1D6;}
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rol(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+  string digest;
+  for (int i = 0; i < 20; i++) {digest += (char)(h[i / 4] >> (24 - (i % 4) * 8));}
+  return digest;
+}
+
+static string base64(const char * data, size_t len) {
+  static const char * CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const unsigned char * p = (const unsigned char *)data;
+  string s;
+  s.reserve((len + 2) / 3 * 4);
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = (p[i] << 16) | ((i + 1 < len) ? p[i + 1] << 8 : 0) | ((i + 2 < len) ? p[i + 2] : 0);
+    s += CHARS[(v >> 18) & 0x3F];
+    s += CHARS[(v >> 12) & 0x3F];
+    s += (i + 1 < len) ? CHARS[(v >> 6) & 0x3F] : '=';
+    s += (i + 2 < len) ? CHARS[v & 0x3F] : '=';
+  }
+  return s;
+}
+
+static string lower(string s) {
+  for (char &ch : s) {ch = tolower(ch);}
+  return s;
+}
+
+// The (URL-decoded) value of the given query argument. Returns false if there is none.
+static bool query_arg(const string &query, const char * name, string &value) {
+  size_t pos = 0;
+  while (pos <= query.length()) {
+    size_t end = query.find('&', pos);
+    if (end == string::npos) {end = query.length();}
+    size_t eq = query.find('=', pos);
+    if (eq < end && query.compare(pos, eq - pos, name) == 0 && strlen(name) == eq - pos) {
+      value.clear();
+      for (size_t i = eq + 1; i < end; i++) {
+        char ch = query[i];
+        if (ch == '+') {
+          ch = ' ';
+        } else if (ch == '%' && i + 2 < end && isxdigit(query[i + 1]) && isxdigit(query[i + 2])) {
+          ch = (char)strtol(query.substr(i + 1, 2).c_str(), NULL, 16);
+          i += 2;
+        }
+        value += ch;
+      }
+      return true;
+    }
+    pos = end + 1;
+  }
+  return false;
+}
+
+static bool to_double(const string &s, double &value) {
+  char * end;
+  value = strtod(s.c_str(), &end);
+  return !s.empty() && *end == '\0';
+}
+
+
+HttpFrontEnd::~HttpFrontEnd() {
+  for (Connection * c : connections) {
+    close(c->fd);
+    delete c;
+  }
+  if (listen_fd >= 0) {close(listen_fd);}
+}
+
+bool HttpFrontEnd::listen(const char * address_str, int port) {
+  struct sockaddr_in address;
+  int opt = 1;
+  listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    return false;
+  }
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  if (inet_pton(AF_INET, address_str, &address.sin_addr) != 1) {
+    return false;
+  }
+  address.sin_port = htons(port);
+  return bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == 0 &&
+         ::listen(listen_fd, 64) == 0 &&
+         fcntl(listen_fd, F_SETFL, O_NONBLOCK) == 0;
+}
+
+void HttpFrontEnd::add_poll_fds(vector<struct pollfd> &fds) {
+  fds.push_back({listen_fd, POLLIN, 0});
+  for (Connection * c : connections) {
+    short events = (c->closing ? 0 : POLLIN) | ((c->out_pos < c->out.length()) ? POLLOUT : 0);
+    fds.push_back({c->fd, events, 0});
+  }
+}
+
+void HttpFrontEnd::service(const vector<struct pollfd> &fds, size_t first) {
+  // I/O for the connections polled.
+  for (size_t i = 0; i < connections.size() && first + 1 + i < fds.size(); i++) {
+    Connection * c = connections[i];
+    short revents = fds[first + 1 + i].revents;
+    if (revents & (POLLERR | POLLNVAL)) {
+      c->dead = true;
+    } else {
+      if ((revents & (POLLIN | POLLHUP)) && !c->closing && !receive(c)) {c->dead = true;}
+      if ((revents & POLLOUT) && !flush(c)) {c->dead = true;}
+    }
+  }
+  if (fds[first].revents & POLLIN) {
+    accept_connections();
+  }
+
+  // Process complete requests. Image requests from all connections are collected and computed together before the
+  // requests that follow them.
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (Connection * c : connections) {
+      while (!c->dead && !c->closing && !c->waiting && (c->websocket ? process_frame(c) : process_request(c))) {
+        progress = true;
+      }
+    }
+    if (!pending_images.empty()) {
+      render_pending_images();
+      progress = true;
+    }
+  }
+
+  // Close connections that are done.
+  for (size_t i = 0; i < connections.size(); ) {
+    Connection * c = connections[i];
+    if (c->dead || (c->closing && c->out_pos == c->out.length())) {
+      close_connection(c);
+      connections.erase(connections.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+void HttpFrontEnd::accept_connections() {
+  int fd;
+  while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+    int opt = 1;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    // Responses are written whole, so there is nothing to gain from delaying them.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    Connection * c = new Connection();
+    c->fd = fd;
+    connections.push_back(c);
+  }
+}
+
+bool HttpFrontEnd::receive(Connection * c) {
+  char buf[1 << 16];
+  while (true) {
+    ssize_t bytes = recv(c->fd, buf, sizeof(buf), 0);
+    if (bytes > 0) {
+      c->in.append(buf, bytes);
+    } else if (bytes == 0) {
+      return false;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool HttpFrontEnd::flush(Connection * c) {
+  while (c->out_pos < c->out.length()) {
+    ssize_t bytes = send(c->fd, c->out.data() + c->out_pos, c->out.length() - c->out_pos, MSG_NOSIGNAL);
+    if (bytes < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      } else if (errno != EINTR) {
+        return false;
+      }
+    } else {
+      c->out_pos += bytes;
+    }
+  }
+  c->out.clear();
+  c->out_pos = 0;
+  return true;
+}
+
+void HttpFrontEnd::close_connection(Connection * c) {
+  if (c->websocket) {
+    LocalResponse response;
+    response.add_input(c->session);
+    app->process_local(END_SESSION, response);
+    app->cout_line() << "WebSocket connection closed (session " << c->session << ")." << endl;
+  }
+  close(c->fd);
+  delete c;
+}
+
+bool HttpFrontEnd::process_request(Connection * c) {
+  const string &in = c->in;
+  size_t header_end = in.find("\r\n\r\n");
+  if (header_end == string::npos) {
+    if (in.length() > MAX_HEADER_BYTES) {
+      send_response(c, "431 Request Header Fields Too Large", NULL, NULL, 0, false);
+    }
+    return false;
+  }
+
+  // Request line.
+  size_t line_end = in.find("\r\n");
+  size_t sp1 = in.find(' ');
+  size_t sp2 = in.rfind(' ', line_end);
+  if (sp1 >= line_end || sp2 <= sp1) {
+    send_response(c, "400 Bad Request", NULL, NULL, 0, false);
+    return false;
+  }
+  string method = in.substr(0, sp1);
+  string target = in.substr(sp1 + 1, sp2 - sp1 - 1);
+  string version = in.substr(sp2 + 1, line_end - sp2 - 1);
+
+  // Headers (by lower-case name).
+  map<string, string> headers;
+  for (size_t pos = line_end + 2; pos < header_end; ) {
+    size_t eol = in.find("\r\n", pos);
+    size_t colon = in.find(':', pos);
+    if (colon < eol) {
+      size_t value = colon + 1;
+      size_t value_end = eol;
+      while (value < value_end && (in[value] == ' ' || in[value] == '\t')) {value++;}
+      while (value_end > value && (in[value_end - 1] == ' ' || in[value_end - 1] == '\t')) {value_end--;}
+      headers[lower(in.substr(pos, colon - pos))] = in.substr(value, value_end - value);
+    }
+    pos = eol + 2;
+  }
+  if (headers.count("transfer-encoding")) {
+    send_response(c, "501 Not Implemented", NULL, NULL, 0, false);
+    return false;
+  }
+
+  // Body (which is ignored).
+  size_t body_bytes = headers.count("content-length") ? strtoul(headers["content-length"].c_str(), NULL, 10) : 0;
+  if (body_bytes > MAX_HEADER_BYTES) {
+    send_response(c, "413 Payload Too Large", NULL, NULL, 0, false);
+    return false;
+  }
+  if (in.length() < header_end + 4 + body_bytes) {
+    return false;
+  }
+  c->in.erase(0, header_end + 4 + body_bytes);
+
+  string connection = lower(headers["connection"]);
+  bool keep_alive = (version == "HTTP/1.1") ? connection.find("close") == string::npos
+                                            : connection.find("keep-alive") != string::npos;
+  size_t q = target.find('?');
+  string path = target.substr(0, q);
+  string query = (q == string::npos) ? "" : target.substr(q + 1);
+
+  if (method == "OPTIONS") {
+    send_response(c, "200 OK", NULL, NULL, 0, keep_alive);
+    return true;
+  }
+  if (method != "GET") {
+    send_response(c, "405 Method Not Allowed", NULL, NULL, 0, keep_alive);
+    return true;
+  }
+
+  // WebSocket.
+  if (path == "/ws" || path.compare(0, 4, "/ws/") == 0) {
+    string key = headers["sec-websocket-key"];
+    if (lower(headers["upgrade"]) != "websocket" || key.empty()) {
+      send_response(c, "400 Bad Request", NULL, NULL, 0, false);
+      return false;
+    }
+    string digest = sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    c->out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+              base64(digest.data(), digest.length()) + "\r\n\r\n";
+    if (!flush(c)) {c->dead = true;}
+    c->websocket = true;
+    c->session = "http-" + to_string(++session_cnt);
+    app->cout_line() << "New WebSocket connection (session " << c->session << ")." << endl;
+    return true;
+  }
+
+  // Images.
+  string params;
+  bool has_params = query_arg(query, "json", params);
+  vector<string> segments;
+  for (size_t pos = 1; pos < path.length(); ) {
+    size_t end = path.find('/', pos);
+    if (end == string::npos) {end = path.length();}
+    segments.push_back(path.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  const string tile("tile");
+  if (segments.size() == 1 && segments[0] == "img") {
+    if (!has_params) {
+      send_response(c, "400 Bad Request", "text/plain", "No json query argument.", 23, keep_alive);
+      return true;
+    }
+  } else if (segments.size() == 5 && segments[0].length() >= tile.length() &&
+             segments[0].compare(segments[0].length() - tile.length(), tile.length(), tile) == 0) {
+    // A map tile, /<type>tile/<depth>/<z>/<x>/<y>, as for OpenLayers, where tiles at zoom level z span [-2, 2].
+    char * depth_end;
+    long depth = strtol(segments[1].c_str(), &depth_end, 10);
+    double z, x, y;
+    bool ok = !segments[1].empty() && *depth_end == '\0' &&
+              to_double(segments[2], z) && to_double(segments[3], x) && to_double(segments[4], y);
+    try {
+      json p = has_params ? json::parse(params) : json::object();
+      if (ok && p.is_object()) {
+        double tile_size = 4.0 / pow(2.0, z);
+        p["x"] = -2.0 + (x + 0.5) * tile_size;
+        p["y"] = -2.0 + (y + 0.5) * tile_size;
+        p["pix_x"] = tile_size / 256.0;
+        p["pix_y"] = tile_size / 256.0;
+        p["width"] = 256;
+        p["height"] = 256;
+        p["max_depth"] = depth;
+        params = p.dump();
+      } else {
+        ok = false;
+      }
+    } catch (const nlohmann::detail::exception &) {
+      ok = false;
+    }
+    if (!ok) {
+      send_response(c, "400 Bad Request", NULL, NULL, 0, keep_alive);
+      return true;
+    }
+  } else {
+    send_response(c, "404 Not Found", NULL, NULL, 0, keep_alive);
+    return true;
+  }
+  pending_images.push_back({c, params, keep_alive});
+  c->waiting = true;
+  return true;
+}
+
+void HttpFrontEnd::render_pending_images() {
+  vector<ImageRequest> pending;
+  pending.swap(pending_images);
+  LocalResponse response;
+  if (pending.size() == 1) {
+    response.add_input(pending[0].params);
+    app->process_local(GET_IMAGE, response);
+  } else {
+    string params("[");
+    for (size_t i = 0; i < pending.size(); i++) {
+      if (i > 0) {params += ",";}
+      params += pending[i].params;
+    }
+    params += "]";
+    response.add_input(params);
+    app->process_local(GET_IMAGES, response);
+  }
+  for (size_t i = 0; i < pending.size(); i++) {
+    Connection * c = pending[i].conn;
+    c->waiting = false;
+    if (i < response.messages.size()) {
+      send_response(c, "200 OK", "image/png", response.messages[i].data(), response.messages[i].length(), pending[i].keep_alive);
+    } else {
+      // (The application has no image behavior.)
+      send_response(c, "501 Not Implemented", NULL, NULL, 0, pending[i].keep_alive);
+    }
+  }
+}
+
+bool HttpFrontEnd::process_frame(Connection * c) {
+  const unsigned char * p = (const unsigned char *)c->in.data();
+  size_t avail = c->in.length();
+  if (avail < 2) {
+    return false;
+  }
+  bool fin = p[0] & 0x80;
+  int opcode = p[0] & 0x0F;
+  bool masked = p[1] & 0x80;
+  uint64_t len = p[1] & 0x7F;
+  size_t pos = 2;
+  if (len == 126) {
+    if (avail < 4) {return false;}
+    len = (p[2] << 8) | p[3];
+    pos = 4;
+  } else if (len == 127) {
+    if (avail < 10) {return false;}
+    len = 0;
+    for (int i = 0; i < 8; i++) {len = (len << 8) | p[2 + i];}
+    pos = 10;
+  }
+  // Client frames must be masked.
+  if (!masked || len > MAX_MESSAGE_BYTES - c->message.length()) {
+    close_websocket(c, masked ? 1009 : 1002);
+    return false;
+  }
+  if (avail < pos + 4 + len) {
+    return false;
+  }
+  const unsigned char * mask = p + pos;
+  pos += 4;
+  string payload(c->in, pos, len);
+  for (size_t i = 0; i < len; i++) {payload[i] ^= mask[i & 3];}
+  c->in.erase(0, pos + len);
+
+  switch (opcode) {
+    case 0x0:  // Continuation.
+      if (!c->message_opcode) {
+        close_websocket(c, 1002);
+        return false;
+      }
+      c->message += payload;
+      if (fin) {
+        string message;
+        message.swap(c->message);
+        c->message_opcode = 0;
+        handle_message(c, message);
+      }
+      break;
+    case 0x1:  // Text.
+    case 0x2:  // Binary.
+      if (c->message_opcode) {
+        close_websocket(c, 1002);
+        return false;
+      }
+      if (fin) {
+        handle_message(c, payload);
+      } else {
+        c->message.swap(payload);
+        c->message_opcode = opcode;
+      }
+      break;
+    case 0x8:  // Close. Respond in kind, with the same status.
+      send_frame(c, 0x8, payload.data(), min(payload.length(), (size_t)2));
+      c->closing = true;
+      return false;
+    case 0x9:  // Ping.
+      send_frame(c, 0xA, payload.data(), payload.length());
+      break;
+    case 0xA:  // Pong.
+      break;
+    default:
+      close_websocket(c, 1002);
+      return false;
+  }
+  return true;
+}
+
+void HttpFrontEnd::close_websocket(Connection * c, int status) {
+  char status_bytes[2] = {(char)(status >> 8), (char)status};
+  send_frame(c, 0x8, status_bytes, 2);
+  c->in.clear();
+  c->closing = true;
+}
+
+void HttpFrontEnd::handle_message(Connection * c, const string &message) {
+  // Messages are as for the web server's WSHandler: {"type": <type>, "payload": <payload>}, and responses are as from
+  // its message handlers.
+  string type;
+  string payload;
+  try {
+    json msg = json::parse(message);
+    type = msg.at("type").get<string>();
+    if (msg.count("payload")) {
+      payload = msg["payload"].is_string() ? msg["payload"].get<string>() : msg["payload"].dump();
+    }
+  } catch (const nlohmann::detail::exception &) {
+    app->cerr_line() << "Malformed WebSocket message." << endl;
+    send_frame(c, "{\"error\": \"Malformed message\"}");
+    return;
+  }
+  json response = {{"type", type}};
+  LocalResponse host_response;
+  const char * session = c->session.c_str();
+
+  if (type == GET_IMAGE) {
+    host_response.add_input(payload);
+    app->process_local(GET_IMAGE, host_response, session);
+    response["type"] = "user";
+    if (!host_response.messages.empty()) {
+      response["png"] = base64(host_response.messages[0].data(), host_response.messages[0].length());
+    }
+  } else if (type == DATA_MSG || type == UPLOAD_DATA_MSG) {
+    // (The data of an UPLOAD_DATA_MSG is already at hand, so it is processed as a DATA_MSG.)
+    host_response.add_input(payload);
+    app->process_local(DATA_MSG, host_response, session);
+    if (!host_response.messages.empty()) {
+      send_frame(c, host_response.messages[0]);
+      return;
+    }
+    response["error"] = "No response";
+  } else if (type == STREAM_DATA_MSG) {
+    // Each batch is sent as it is produced, and the end is marked by {"type": "STREAM_DATA_MSG", "done": true}.
+    host_response.forward = [this, c](const char * data, uint32_t len) {
+      if (len) {send_frame(c, 0x1, data, len);}
+    };
+    host_response.add_input(payload);
+    app->process_local(STREAM_DATA_MSG, host_response, session);
+    response["done"] = true;
+  } else if (type == STATS) {
+    app->process_local(STATS, host_response);
+    response["stats"] = host_response.messages.empty() ? json::object() : json::parse(host_response.messages[0]);
+  } else if (type == LOAD_MEMORY) {
+    host_response.add_input(payload);
+    app->process_local(LOAD_MEMORY, host_response, session);
+    if (!host_response.messages.empty()) {
+      response = json::parse(host_response.messages[0]);
+      response["type"] = type;
+    }
+  } else if (type == SAVE_CHECKPOINT) {
+    app->process_local(SAVE_CHECKPOINT, host_response, session);
+  } else if (type == START_TRACING || type == STOP_TRACING) {
+    app->process_local(type.c_str(), host_response);
+  } else if (type != "PING") {
+    app->cerr_line() << "Unrecognized WebSocket message type: " << type << "." << endl;
+    response["error"] = "Unrecognized message type";
+  }
+  send_frame(c, response.dump());
+}
+
+void HttpFrontEnd::send_response(Connection * c, const char * status, const char * content_type, const char * body, size_t len, bool keep_alive) {
+  if (c->dead) {
+    return;
+  }
+  string &out = c->out;
+  out += "HTTP/1.1 ";
+  out += status;
+  // As from the web server, to allow requests from pages served from elsewhere.
+  out += "\r\nAccess-Control-Allow-Origin: *\r\nAccess-Control-Allow-Headers: x-requested-with\r\nAccess-Control-Allow-Methods: POST, GET, OPTIONS\r\n";
+  if (content_type) {
+    out += "Content-Type: ";
+    out += content_type;
+    out += "\r\n";
+  }
+  out += "Content-Length: " + to_string(len) + "\r\n";
+  out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+  out.append(body ? body : "", len);
+  if (!keep_alive) {
+    c->closing = true;
+  }
+  if (!flush(c)) {
+    c->dead = true;
+  }
+}
+
+void HttpFrontEnd::send_frame(Connection * c, int opcode, const char * data, size_t len) {
+  if (c->dead) {
+    return;
+  }
+  string &out = c->out;
+  out += (char)(0x80 | opcode);
+  if (len < 126) {
+    out += (char)len;
+  } else if (len < 65536) {
+    out += (char)126;
+    out += (char)(len >> 8);
+    out += (char)len;
+  } else {
+    out += (char)127;
+    for (int i = 7; i >= 0; i--) {out += (char)((uint64_t)len >> (i * 8));}
+  }
+  out.append(data, len);
+  if (!flush(c)) {
+    c->dead = true;
+  }
+}
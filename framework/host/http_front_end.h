@@ -0,0 +1,128 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** An HTTP/1.1 and WebSocket front end for HostApp, serving the image and WebSocket requests otherwise served by the
+** Python web server, without the round trip through Python. The web server continues to serve static content and EC2
+** management (and still forwards its own requests over the socket).
+**
+** Served are:
+**   GET /img?json={...}                        An image (GET_IMAGE), as for the web server's ImageHandler.
+**   GET /<type>tile/<depth>/<z>/<x>/<y>[?json={...}]   A map tile (GET_IMAGE), as above.
+**   /ws, /ws/<token>                           A WebSocket, with the messages of the web server's WSHandler. Each
+**                                              WebSocket is a session with its own kernel context.
+** Image requests that arrive together (e.g. the tiles of a view) are computed together (GET_IMAGES).
+**
+** Requests are processed by HostApp's command handlers, with a local channel in place of the socket, on the main
+** thread, in turn with the web server's requests. Connections are non-blocking, so a slow client does not stall the
+** host.
+**
+*/
+
+#ifndef HEADER_HTTP_FRONT_END
+#define HEADER_HTTP_FRONT_END
+
+#include <string>
+#include <vector>
+#include <poll.h>
+#include "server_main.h"
+
+
+class HttpFrontEnd {
+
+public:
+  static const size_t MAX_HEADER_BYTES = 64 << 10;     // Larger request headers are rejected.
+  static const size_t MAX_MESSAGE_BYTES = 256 << 20;   // Larger WebSocket messages are rejected.
+
+  HttpFrontEnd(HostApp * app) : app(app) {}
+  ~HttpFrontEnd();
+
+  /*
+  ** Listen on the given TCP port of the given (IPv4) address, e.g. "0.0.0.0" for all interfaces. Returns false on
+  ** failure.
+  */
+  bool listen(const char * address, int port);
+  /*
+  ** Add the file descriptors to poll(..) for the front end to fds, and service them following poll(..). fds[first] is
+  ** the first added.
+  */
+  void add_poll_fds(std::vector<struct pollfd> &fds);
+  void service(const std::vector<struct pollfd> &fds, size_t first);
+
+private:
+  struct Connection {
+    int fd;
+    std::string in;   // Received data, not yet processed.
+    std::string out;  // Data to send, from out_pos.
+    size_t out_pos = 0;
+    bool websocket = false;
+    bool waiting = false;  // An image request is pending (so later requests must wait).
+    bool closing = false;  // Close once out is sent.
+    bool dead = false;     // Close now.
+    std::string session;   // The kernel session of a WebSocket.
+    std::string message;   // A fragmented WebSocket message, as received so far.
+    int message_opcode = 0;
+  };
+  struct ImageRequest {
+    Connection * conn;
+    std::string params;  // GET_IMAGE parameters (JSON).
+    bool keep_alive;
+  };
+
+  HostApp * app;
+  int listen_fd = -1;
+  std::vector<Connection *> connections;
+  std::vector<ImageRequest> pending_images;
+  int session_cnt = 0;
+
+  void accept_connections();
+  // Receive or send what is possible without blocking. Return false if the connection failed.
+  bool receive(Connection * c);
+  bool flush(Connection * c);
+  void close_connection(Connection * c);
+
+  // Process the next complete request (or WebSocket frame) of c. Return false if there is none.
+  bool process_request(Connection * c);
+  bool process_frame(Connection * c);
+  // Render pending_images, and respond to each.
+  void render_pending_images();
+  void handle_message(Connection * c, const std::string &message);
+  // Close a WebSocket with the given status code (following a protocol error).
+  void close_websocket(Connection * c, int status);
+
+  void send_response(Connection * c, const char * status, const char * content_type, const char * body, size_t len, bool keep_alive);
+  void send_frame(Connection * c, int opcode, const char * data, size_t len);
+  void send_frame(Connection * c, const std::string &text) {send_frame(c, 0x1, text.data(), text.length());}
+};
+
+#endif
@@ -50,11 +50,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <time.h>
 #include "kernel.h"
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include <CL/opencl.h>
 #include <CL/cl_ext.h>
 #include "server_main.h"
+#include "buffer_pool.h"
 
 #if defined(VITIS_PLATFORM)
 #define STR_VALUE(arg)      #arg
@@ -71,32 +74,41 @@ void HW_Kernel::perror(const char * msg) {
   status = EXIT_FAILURE;
 }
 
-cl_uint HW_Kernel::load_file_to_memory(const char *filename, char **result) {
-  cl_uint size = 0;
-  FILE *f = fopen(filename, "rb");
-  if (f == NULL) {
-    *result = NULL;
-    return -1; // -1 means file opening fail
-  }
-  fseek(f, 0, SEEK_END);
-  size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  *result = (char *)malloc(size+1);
-  if (size != fread(*result, sizeof(char), size, f)) {
-    free(*result);
-    return -2; // -2 means file reading fail
-  }
-  fclose(f);
-  (*result)[size] = 0;
+const unsigned char * HW_Kernel::map_file_to_memory(const char *filename, size_t *size) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  void * mem = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    *size = st.st_size;
+    mem = mmap(NULL, *size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  }
+  close(fd);  // (The mapping remains valid.)
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
   // For Debugging
   if (verbosity > 0)
   {
-    printf("File loaded to memory\n");
+    printf("File mapped to memory\n");
   }
-  return size;
+  return (const unsigned char *)mem;
+}
+
+// Milliseconds since the given time, updating it to now.
+static double lap_ms(struct timespec &since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double ms = (now.tv_sec - since.tv_sec) * 1000.0 + (now.tv_nsec - since.tv_nsec) / 1000000.0;
+  since = now;
+  return ms;
 }
 
 void HW_Kernel::initialize_platform() {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
   // Get all platforms and then select Xilinx platform
   cl_platform_id platforms[16];       // platform id
   cl_uint platform_count;
@@ -121,7 +133,7 @@ void HW_Kernel::initialize_platform() {
     printf("INFO: Found %d platforms\n", platform_count);
   }
 
-  // Finds an available Xilinx Platform
+  // Finds an available platform from the configured vendor (normally Xilinx)
   for (unsigned int iplat=0; iplat<platform_count; iplat++) {
     err = clGetPlatformInfo(platforms[iplat], CL_PLATFORM_VENDOR, 1000, (void *)cl_platform_vendor,NULL);
     if (err != CL_SUCCESS) {
@@ -129,7 +141,7 @@ void HW_Kernel::initialize_platform() {
       return;
     }
 
-    if (strcmp(cl_platform_vendor, "Xilinx") == 0) {
+    if (strcmp(cl_platform_vendor, platform_vendor) == 0) {
       printf("INFO: Selected platform %d from %s\n", iplat, cl_platform_vendor);
       platform_id = platforms[iplat];
       //printf("INFO: Platform id = %d\n", platform_id);
@@ -138,9 +150,12 @@ void HW_Kernel::initialize_platform() {
   }
 
   if (!platform_found) {
-    perror("ERROR: Platform Xilinx not found. Exit.\n");
+    printf("ERROR: Platform %s not found. Exit.\n", platform_vendor);
+    status = EXIT_FAILURE;
     return;
   }
+  // A stand-in platform (e.g. a CPU OpenCL implementation) has no Xilinx target device, so take its first device.
+  bool stand_in = strcmp(platform_vendor, "Xilinx") != 0;
 
   // Connection to a compute device
   int fpga = 0;
@@ -148,14 +163,15 @@ void HW_Kernel::initialize_platform() {
       fpga = 1;
   #endif
   printf("get device, fpga is %d \n", fpga);
-  err = clGetDeviceIDs(platform_id, fpga ? CL_DEVICE_TYPE_ACCELERATOR : CL_DEVICE_TYPE_CPU,
+  err = clGetDeviceIDs(platform_id, stand_in ? CL_DEVICE_TYPE_ALL : fpga ? CL_DEVICE_TYPE_ACCELERATOR : CL_DEVICE_TYPE_CPU,
                16, devices, &num_devices);
   if (err != CL_SUCCESS) {
     perror("Error: Failed to create a device group!\nTest failed\n");
     return;
   }
 
-  //iterate all devices to select the target device.
+  //iterate all devices to select the target device (the device_index'th match), counting the matches.
+    num_devices_found = 0;
     for (cl_uint i=0; i<num_devices; i++) {
         err = clGetDeviceInfo(devices[i], CL_DEVICE_NAME, 1024, cl_device_name, 0);
         if (err != CL_SUCCESS) {
@@ -164,18 +180,13 @@ void HW_Kernel::initialize_platform() {
             return;
         }
         
-        if (fpga == 0)
-        {
-         if(strcmp(cl_device_name, target_device_name) == 0) {
+        if ((fpga == 0 && !stand_in) ? strcmp(cl_device_name, target_device_name) == 0 : true) {
+          if (num_devices_found == device_index) {
             device_id = devices[i];
             device_found = 1;
-            printf("Selected %s as the target device\n", cl_device_name);
+            printf("Selected %s (device %d) as the target device\n", cl_device_name, i);
           }
-        }
-        else {
-            device_id = devices[i];
-            device_found = 1;
-            printf("Selected %s as the target device\n", cl_device_name);
+          num_devices_found++;
         }}
 
     if (!device_found) {
@@ -198,6 +209,7 @@ void HW_Kernel::initialize_platform() {
   }
 
   status = 0;
+  init_phases_ms["platform"] = lap_ms(start);
 
   if (verbosity > 0)
   {
@@ -205,11 +217,13 @@ void HW_Kernel::initialize_platform() {
   }
 }
 
-void HW_Kernel::initialize_kernel(const char *xclbin, const char *kernel_name, int memory_size) {
+void HW_Kernel::initialize_kernel(const char *xclbin, const char *kernel_name, size_t max_buffer_bytes) {
   int err;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
   // Create Program Objects
-  // Load binary from disk
-  unsigned char *kernelbinary;
+  // Map binary from disk (rather than copying it)
+  const unsigned char *kernelbinary;
 
   //------------------------------------------------------------------------------
   // xclbin
@@ -218,21 +232,27 @@ void HW_Kernel::initialize_kernel(const char *xclbin, const char *kernel_name, i
   {
     printf("INFO: Loading xclbin %s\n", xclbin);
   }
-  cl_uint n_i0 = load_file_to_memory(xclbin, (char **) &kernelbinary);
-  if (n_i0 < 0) {
+  size_t n0 = 0;
+  kernelbinary = map_file_to_memory(xclbin, &n0);
+  if (kernelbinary == NULL) {
     perror("Error: Failed to load kernel from the xclbin provided\nTest failed\n");
     return;
   }
-  size_t n0 = n_i0;
+  init_phases_ms["xclbin_map"] = lap_ms(start);
   if (verbosity > 0)
   {
     printf("CL Start create Program\n");
   }
-  // Create the compute program from offline
-  program = clCreateProgramWithBinary(context, 1, &device_id, &n0,
-                                      (const unsigned char **) &kernelbinary, &status, &err);
-  // TODO: Looks like kernelbinary is never deallocated. What's the right behavior, here?
-  free(kernelbinary);
+  // Create the compute program from offline, or, for OpenCL C source (for a stand-in platform), from source.
+  size_t name_len = strlen(xclbin);
+  if (name_len > 3 && strcmp(&xclbin[name_len - 3], ".cl") == 0) {
+    program = clCreateProgramWithSource(context, 1, (const char **)&kernelbinary, &n0, &err);
+  } else {
+    program = clCreateProgramWithBinary(context, 1, &device_id, &n0,
+                                        &kernelbinary, &status, &err);
+  }
+  munmap((void *)kernelbinary, n0);
+  init_phases_ms["program_create"] = lap_ms(start);
 
   if ((!program) || (err!=CL_SUCCESS)) {
     perror("Error: Failed to create a compute program binary!\nTest failed\n");
@@ -252,6 +272,7 @@ void HW_Kernel::initialize_kernel(const char *xclbin, const char *kernel_name, i
       printf("Test failed\n");
       status = EXIT_FAILURE;
   }
+  init_phases_ms["program_build"] = lap_ms(start);
 
   // Create the compute kernel in the program we wish to run
   kernel = clCreateKernel(program, kernel_name, &err);
@@ -262,21 +283,18 @@ void HW_Kernel::initialize_kernel(const char *xclbin, const char *kernel_name, i
     perror("Error: Failed to create a compute kernel!\nTest failed\n");
     return;
   }
+  init_phases_ms["kernel_create"] = lap_ms(start);
 
-  // Create the input and output arrays in device memory for our calculation
-  //
-  // This must be modified by the user if the number (or name) of the arguments is different from this
-  // application
+  // The input and output arrays in device memory are created on demand, sized to the requests (see fit_buffer).
+  // Each is limited by the cap given and by the device.
   //
-  //read_mem  = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(int) * memory_size, NULL, NULL);
-  //write_mem = read_mem;
-  read_mem  = clCreateBuffer(context, CL_MEM_READ_ONLY ,  sizeof(int) * memory_size, NULL, NULL);  // TODO: Fix memory_size.
-  write_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY,  sizeof(int) * memory_size, NULL, NULL);
-
-  if (!(write_mem) || !(read_mem)) {
-    perror("Error: Failed to allocate device memory!\nTest failed\n");
-    return;
+  cl_ulong max_alloc = 0;
+  this->max_buffer_bytes = max_buffer_bytes;
+  if (clGetDeviceInfo(device_id, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL) == CL_SUCCESS &&
+      max_alloc > 0 && max_alloc < this->max_buffer_bytes) {
+    this->max_buffer_bytes = (size_t)max_alloc;
   }
+  load_set = unload_set = jobs_in_flight = 0;
 
   status = 0;
 
@@ -290,7 +308,11 @@ void HW_Kernel::write_kernel_data(double h_a_input[], int data_size){
   perror("Oh! I thought write_kernel_data(double h_a_input[], int data_size) was unused.\n");
 
   int err;
-  err = clEnqueueWriteBuffer(commands, read_mem, CL_TRUE, 0, data_size, h_a_input, 0, NULL, NULL);
+  BufferSet &set = buffer_sets[load_set];
+  if (!fit_buffer(set.read_mem, set.read_capacity, data_size, CL_MEM_READ_ONLY)) {
+    return;
+  }
+  err = clEnqueueWriteBuffer(commands, set.read_mem, CL_TRUE, 0, data_size, h_a_input, 0, NULL, NULL);
   if (err != CL_SUCCESS) {
     perror("Error: Failed to write to source array h_a_input!\nTest failed\n");
     return;
@@ -299,8 +321,8 @@ void HW_Kernel::write_kernel_data(double h_a_input[], int data_size){
   // Set the arguments of the kernel. This must be modified by the user depending on the number (or name)
   // of the arguments
   err = 0;
-  err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &read_mem);
-  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &write_mem);
+  err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &set.read_mem);
+  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &set.write_mem);
 
   if (err != CL_SUCCESS) {
     perror("Error: Failed to set kernel arguments!\nTest failed\n");
@@ -308,52 +330,252 @@ void HW_Kernel::write_kernel_data(double h_a_input[], int data_size){
   }
 }
 
-// TODO: Experimental WIP
-void HW_Kernel::writeKernelData(void * input, int data_size, int resp_data_size) {
+HW_Kernel::BufferSet * HW_Kernel::load_buffer_set(int data_size, int resp_data_size) {
+  if (jobs_in_flight >= HW_BUFFER_SETS) {
+    perror("Error: All device buffer sets are in use. Read a response before writing another job.\n");
+    return NULL;
+  }
+  BufferSet *set = &buffer_sets[load_set];
+  if (set->out_map) {
+    perror("Error: The response of this buffer set's previous job is still mapped.\n");
+    return NULL;
+  }
+  release_events(*set);
+  // (A mapped input buffer was sized by map_input.)
+  if ((set->in_map ? (size_t)data_size > set->read_capacity
+                   : !fit_buffer(set->read_mem, set->read_capacity, data_size, CL_MEM_READ_ONLY)) ||
+      !fit_buffer(set->write_mem, set->write_capacity, resp_data_size, CL_MEM_WRITE_ONLY)) {
+    perror("Error: Could not size device buffers for the request.\n");
+    return NULL;
+  }
+  set->data_size = data_size;
+  set->resp_bytes = resp_data_size;
+  resp_bytes = resp_data_size;
+  return set;
+}
+
+HW_Kernel::BufferSet * HW_Kernel::unload_buffer_set() {
+  if (jobs_in_flight <= 0) {
+    perror("Error: No kernel job is in flight.\n");
+    return NULL;
+  }
+  return &buffer_sets[unload_set];
+}
+
+bool HW_Kernel::fit_buffer(cl_mem &mem, size_t &capacity, size_t bytes, cl_mem_flags flags) {
+  if (mem && bytes <= capacity) {
+    return true;
+  }
+  if (bytes > max_buffer_bytes) {
+    printf("Error: %lu-byte device buffer requested, exceeding the cap of %lu bytes.\n", (unsigned long)bytes, (unsigned long)max_buffer_bytes);
+    status = EXIT_FAILURE;
+    return false;
+  }
+  // Grow to the next size class. The buffer is not in use, since its set has no job in flight.
+  size_t new_capacity = MIN_BUFFER_BYTES;
+  while (new_capacity < bytes) {
+    new_capacity <<= 1;
+  }
+  if (new_capacity > max_buffer_bytes) {
+    new_capacity = max_buffer_bytes;
+  }
+  if (mem) {
+    clReleaseMemObject(mem);
+    device_bytes -= capacity;
+  }
   int err;
-  err = clEnqueueWriteBuffer(commands, read_mem, CL_TRUE, 0, data_size, input, 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    perror("Error: Failed to write to source array h_a_input!\nTest failed\n");
+  mem = clCreateBuffer(context, flags | CL_MEM_ALLOC_HOST_PTR, new_capacity, NULL, &err);
+  if (!mem || err != CL_SUCCESS) {
+    mem = NULL;
+    capacity = 0;
+    perror("Error: Failed to allocate device memory!\n");
+    return false;
+  }
+  capacity = new_capacity;
+  device_bytes += capacity;
+  if (device_bytes > peak_device_bytes) {
+    peak_device_bytes = device_bytes;
+  }
+  buffer_grows++;
+  if (verbosity > 0) {
+    printf("Device buffer grown to %lu bytes (%lu bytes total).\n", (unsigned long)capacity, (unsigned long)device_bytes);
+  }
+  return true;
+}
+
+void HW_Kernel::finish_job(BufferSet &set, cl_event first_read, cl_event last_read) {
+  if (first_read && last_read) {
+    profile_job(set, first_read, last_read);
+  }
+  release_events(set);
+  unload_set = (unload_set + 1) % HW_BUFFER_SETS;
+  jobs_in_flight--;
+}
+
+// Timestamps (ns) of an event's command from CL_QUEUE_PROFILING_ENABLE.
+struct EventTimes {
+  cl_ulong queued, submit, start, end;
+};
+
+static bool get_event_times(cl_event event, EventTimes &t) {
+  return clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &t.queued, NULL) == CL_SUCCESS &&
+         clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &t.submit, NULL) == CL_SUCCESS &&
+         clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,  sizeof(cl_ulong), &t.start,  NULL) == CL_SUCCESS &&
+         clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,    sizeof(cl_ulong), &t.end,    NULL) == CL_SUCCESS;
+}
+
+// Difference of device timestamps, or 0 if out of order (as when commands overlap).
+static uint64_t elapsed(cl_ulong from, cl_ulong to) {
+  return (to > from) ? to - from : 0;
+}
+
+void HW_Kernel::profile_job(BufferSet &set, cl_event first_read, cl_event last_read) {
+  EventTimes w, k, r0, r1;
+  if (!set.write_done || !set.kernel_done ||
+      !get_event_times(set.write_done, w) || !get_event_times(set.kernel_done, k) ||
+      !get_event_times(first_read, r0) || !get_event_times(last_read, r1)) {
     return;
   }
+  profile.write_dma.record(elapsed(w.start, w.end));
+  profile.kernel.record(elapsed(k.start, k.end));
+  profile.read_dma.record(elapsed(r0.start, r1.end));
+  profile.queue_wait.record(elapsed(w.queued, w.start));
+  profile.queue_wait.record(elapsed(k.queued, k.start));
+  profile.queue_wait.record(elapsed(r0.queued, r0.start));
+  profile.write_to_kernel.record(elapsed(w.end, k.start));
+  profile.kernel_to_read.record(elapsed(k.end, r0.start));
+  if (profile.last_read_end) {
+    profile.device_idle.record(elapsed(profile.last_read_end, w.start));
+  }
+  profile.total.record(elapsed(w.queued, r1.end));
+  profile.last_read_end = r1.end;
+}
 
-  // Set the arguments of the kernel. This must be modified by the user depending on the number (or name)
-  // of the arguments
-  err = 0;
-  err |= clSetKernelArg(kernel, 0, sizeof(uint), &data_size);
-  err |= clSetKernelArg(kernel, 1, sizeof(uint), &resp_data_size);
-  err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &read_mem);
-  err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &write_mem);
+void HW_Kernel::add_stats(nlohmann::json &stats) {
+  stats["write_dma"] = profile.write_dma.to_json();
+  stats["kernel"] = profile.kernel.to_json();
+  stats["read_dma"] = profile.read_dma.to_json();
+  stats["queue_wait"] = profile.queue_wait.to_json();
+  stats["write_to_kernel_gap"] = profile.write_to_kernel.to_json();
+  stats["kernel_to_read_gap"] = profile.kernel_to_read.to_json();
+  stats["device_idle"] = profile.device_idle.to_json();
+  stats["total"] = profile.total.to_json();
+  stats["init_ms"] = init_phases_ms;
+  stats["device_memory"] = {{"bytes", device_bytes}, {"peak_bytes", peak_device_bytes}, {"cap_bytes", max_buffer_bytes},
+                            {"grows", buffer_grows}};
+}
 
-  if (err != CL_SUCCESS) {
-    perror("Error: Failed to set kernel arguments!\nTest failed\n");
+void HW_Kernel::release_events(BufferSet &set) {
+  if (set.write_done) {clReleaseEvent(set.write_done); set.write_done = NULL;}
+  if (set.kernel_done) {clReleaseEvent(set.kernel_done); set.kernel_done = NULL;}
+}
+
+// TODO: Experimental WIP
+void HW_Kernel::writeKernelData(void * input, int data_size, int resp_data_size) {
+  // The shell transfers exactly resp_data_size bytes of response, so it cannot be unbounded (and out_last is ignored).
+  if (resp_data_size < 0) {
+    perror("Error: The hardware kernel requires a bounded response size.\n");
     return;
   }
+  BufferSet *set = load_buffer_set(data_size, resp_data_size);
+  if (!set) {
+    return;
+  }
+  upload(*set, input, data_size);
 }
 
-void HW_Kernel::write_kernel_data(input_struct * input, int data_size) {
+void HW_Kernel::upload(BufferSet &set, void * input, int data_size) {
   int err;
-  err = clEnqueueWriteBuffer(commands, read_mem, CL_TRUE, 0, data_size, input, 0, NULL, NULL);
+  // Non-blocking; the kernel waits on write_done.
+  if (input != NULL && input == set.in_map) {
+    err = clEnqueueUnmapMemObject(commands, set.read_mem, input, 0, NULL, &set.write_done);
+    set.in_map = NULL;
+  } else {
+    err = clEnqueueWriteBuffer(commands, set.read_mem, CL_FALSE, 0, data_size, input, 0, NULL, &set.write_done);
+  }
   if (err != CL_SUCCESS) {
     perror("Error: Failed to write to source array h_a_input!\nTest failed\n");
     return;
   }
+}
 
-  // Set the arguments of the kernel. This must be modified by the user depending on the number (or name)
-  // of the arguments
-  err = 0;
-  uint resp_length = (uint)(input->width * input->height) / 16 * HostApp::DATA_WIDTH_BYTES;
-  cout << "C++: (" << input->width << "x" << input->height << "), resp_length = " << resp_length << endl;
-  //perror("C++: UNTESTED write_kernel_data\n");
-  err |= clSetKernelArg(kernel, 0, sizeof(uint), &data_size);
-  err |= clSetKernelArg(kernel, 1, sizeof(uint), &resp_length);
-  err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &read_mem);
-  err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &write_mem);
+void * HW_Kernel::map_input(int data_size) {
+  int err;
+  if (jobs_in_flight >= HW_BUFFER_SETS) {
+    perror("Error: All device buffer sets are in use. Read a response before writing another job.\n");
+    return NULL;
+  }
+  BufferSet &set = buffer_sets[load_set];
+  if (set.in_map && (size_t)data_size > set.read_capacity) {
+    perror("Error: Kernel input buffer is already mapped, with insufficient capacity.\n");
+    return NULL;
+  }
+  if (!set.in_map) {
+    // The set's previous job has been read, so its kernel is no longer using read_mem.
+    if (!fit_buffer(set.read_mem, set.read_capacity, data_size, CL_MEM_READ_ONLY)) {
+      return NULL;
+    }
+    set.in_map = clEnqueueMapBuffer(commands, set.read_mem, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, data_size, 0, NULL, NULL, &err);
+    if (err != CL_SUCCESS) {
+      perror("Error: Failed to map kernel input buffer!\n");
+      set.in_map = NULL;
+    }
+  }
+  return set.in_map;
+}
 
+int * HW_Kernel::map_output(int data_size) {
+  int err;
+  BufferSet *set = unload_buffer_set();
+  if (!set) {
+    return NULL;
+  }
+  // Blocking, once this job's kernel completes.
+  cl_event mapevent = NULL;
+  set->out_map = clEnqueueMapBuffer(commands, set->write_mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, data_size, 1, &set->kernel_done, &mapevent, &err);
   if (err != CL_SUCCESS) {
-    perror("Error: Failed to set kernel arguments!\nTest failed\n");
+    perror("Error: Failed to map kernel output buffer!\n");
+    set->out_map = NULL;
+  }
+  finish_job(*set, mapevent, mapevent);
+  if (mapevent) {clReleaseEvent(mapevent);}
+  return (int *)set->out_map;
+}
+
+void HW_Kernel::unmap_output(void * output) {
+  for (int i = 0; i < HW_BUFFER_SETS; i++) {
+    BufferSet &set = buffer_sets[i];
+    if (output != NULL && set.out_map == output) {
+      // Wait for the unmap, so the set's next kernel cannot overtake it in the out-of-order queue.
+      cl_event unmapped;
+      if (clEnqueueUnmapMemObject(commands, set.write_mem, output, 0, NULL, &unmapped) == CL_SUCCESS) {
+        clWaitForEvents(1, &unmapped);
+        clReleaseEvent(unmapped);
+      }
+      set.out_map = NULL;
+      return;
+    }
+  }
+  perror("Error: unmap_output given a buffer that is not mapped.\n");
+}
+
+bool HW_Kernel::is_mapped_output(const void * output) {
+  for (int i = 0; i < HW_BUFFER_SETS; i++) {
+    if (output != NULL && buffer_sets[i].out_map == output) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HW_Kernel::write_kernel_data(input_struct * input, int data_size) {
+  uint resp_length = (uint)input_struct_pixels(input, data_size) / 16 * HostApp::DATA_WIDTH_BYTES;
+  cout << "C++: (" << input->width << "x" << input->height << (data_size > HostApp::DATA_WIDTH_BYTES ? ", ..." : "") << "), resp_length = " << resp_length << endl;
+  BufferSet *set = load_buffer_set(data_size, resp_length);
+  if (!set) {
     return;
   }
+  upload(*set, input, data_size);
 }
 
 void HW_Kernel::start_kernel() {
@@ -368,47 +590,161 @@ void HW_Kernel::start_kernel() {
   // clEnqueueTask is equivalent to calling clEnqueueNDRangeKernel with
   // work_dim = 1, global_work_offset = NULL, global_work_size[0] set to 1, and local_work_size[0] set to 1.
 
+  BufferSet &set = buffer_sets[load_set];
+  if (!set.write_done) {
+    perror("Error: No kernel input has been written.\n");
+    return;
+  }
+
+  // Set the arguments of the kernel. This must be modified by the user depending on the number (or name)
+  // of the arguments. Argument values are captured when the kernel is enqueued, so each job in flight has its own.
+  err = 0;
+  err |= clSetKernelArg(kernel, 0, sizeof(uint), &set.data_size);
+  err |= clSetKernelArg(kernel, 1, sizeof(uint), &set.resp_bytes);
+  err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &set.read_mem);
+  err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &set.write_mem);
+
+  if (err != CL_SUCCESS) {
+    perror("Error: Failed to set kernel arguments!\nTest failed\n");
+    return;
+  }
+
   global[0] = 1;
   local[0] = 1;
-  err = clEnqueueNDRangeKernel(commands, kernel, 1, NULL, (size_t*)&global, (size_t*)&local, 0, NULL, NULL);
+  err = clEnqueueNDRangeKernel(commands, kernel, 1, NULL, (size_t*)&global, (size_t*)&local, 1, &set.write_done, &set.kernel_done);
   if (err) {
     perror("Error: Failed to execute kernel!\nTest failed\n");
     return;
   }
+  // Submit now, so the device works on this job while the host prepares the next or reads the previous.
+  clFlush(commands);
 
-  // Read back the results from the device to verify the output
-  //
-
+  load_set = (load_set + 1) % HW_BUFFER_SETS;
+  jobs_in_flight++;
   status = 0;
 }
 
-void HW_Kernel::read_kernel_data(int h_a_output[], int data_size) {
+int HW_Kernel::read_kernel_data(int h_a_output[], int data_size) {
   int err;
   cl_event readevent;
 
-  clFinish(commands);
+  BufferSet *set = unload_buffer_set();
+  if (!set) {
+    return 0;
+  }
 
   /* Prepopulate buffer for debug
   for (int i = 0; i < data_size / (int)sizeof(int); i++) {
     h_a_output[i] = i;
   }
   */
-  err |= clSetKernelArg(kernel, 0, sizeof(uint), &data_size);
 
-  err = clEnqueueReadBuffer(commands, write_mem, CL_TRUE, 0, data_size, h_a_output, 0, NULL, &readevent);
+  // Wait only on this job's kernel, not the whole queue, which may hold later jobs.
+  err = clEnqueueReadBuffer(commands, set->write_mem, CL_TRUE, 0, data_size, h_a_output, 1, &set->kernel_done, &readevent);
 
   if (err != CL_SUCCESS) {
+    finish_job(*set, NULL, NULL);
     perror("Error: Failed to read output array h_a_output!\nTest failed\n");
-    return;
+    return 0;
   }
 
   clWaitForEvents(1, &readevent);
+  finish_job(*set, readevent, readevent);
+  clReleaseEvent(readevent);
+  return data_size;
+}
+
+bool HW_Kernel::start_job(void * input, int data_size, int resp_data_size) {
+  int prev_jobs_in_flight = jobs_in_flight;
+  writeKernelData(input, data_size, resp_data_size);
+  start_kernel();
+  return jobs_in_flight > prev_jobs_in_flight;
+}
+
+void HW_Kernel::stream_kernel(KernelOutputSink &sink, int batch_words) {
+  start_kernel();
+  stream_response(sink, batch_words);
+}
+
+void HW_Kernel::stream_response(KernelOutputSink &sink, int batch_words) {
+  BufferSet *set = unload_buffer_set();
+  if (!set) {
+    return;
+  }
+  int words = set->resp_bytes / HostApp::DATA_WIDTH_BYTES;
+  int * output = (int *)BufferPool::shared().alloc(set->resp_bytes);
+  // Enqueue a read per batch, then deliver each as it lands, while the following batches are still transferring.
+  int batches = (words + batch_words - 1) / batch_words;
+  cl_event *read_done = new cl_event[batches];
+  int enqueued = 0;
+  for (; enqueued < batches; enqueued++) {
+    int w = enqueued * batch_words;
+    size_t offset = (size_t)w * HostApp::DATA_WIDTH_BYTES;
+    size_t bytes = (size_t)((words - w < batch_words) ? words - w : batch_words) * HostApp::DATA_WIDTH_BYTES;
+    if (clEnqueueReadBuffer(commands, set->write_mem, CL_FALSE, offset, bytes, (char *)output + offset,
+                            1, &set->kernel_done, &read_done[enqueued]) != CL_SUCCESS) {
+      perror("Error: Failed to read output array!\nTest failed\n");
+      break;
+    }
+  }
+  clFlush(commands);
+  for (int b = 0; b < enqueued; b++) {
+    int w = b * batch_words;
+    clWaitForEvents(1, &read_done[b]);
+    sink.consume((uint32_t *)output + w * HostApp::DATA_WIDTH_WORDS, (words - w < batch_words) ? words - w : batch_words);
+  }
+  finish_job(*set, enqueued ? read_done[0] : NULL, enqueued ? read_done[enqueued - 1] : NULL);
+  for (int b = 0; b < enqueued; b++) {
+    clReleaseEvent(read_done[b]);
+  }
+  delete [] read_done;
+  BufferPool::shared().release(output);
+}
+
+void HW_Kernel::stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words) {
+  if (resp_data_size < 0) {
+    perror("Error: The hardware kernel requires a bounded response size.\n");
+    return;
+  }
+  BufferSet *set = load_buffer_set(data_size, resp_data_size);
+  if (!set) {
+    return;
+  }
+  // The source's data is valid only until the next is requested, so each write completes first. The last write's
+  // event is the job's write_done.
+  int offset = 0;
+  int words;
+  const uint32_t * data;
+  while (offset < data_size && (data = source.produce(words)) != NULL) {
+    int bytes = words * HostApp::DATA_WIDTH_BYTES;
+    if (bytes > data_size - offset) {bytes = data_size - offset;}
+    if (set->write_done) {clReleaseEvent(set->write_done); set->write_done = NULL;}
+    if (clEnqueueWriteBuffer(commands, set->read_mem, CL_FALSE, offset, bytes, data, 0, NULL, &set->write_done) != CL_SUCCESS) {
+      perror("Error: Failed to write to source array h_a_input!\nTest failed\n");
+      return;
+    }
+    clWaitForEvents(1, &set->write_done);
+    offset += bytes;
+  }
+  if (offset < data_size) {
+    cout << "Warning: Kernel input ended after " << offset / HostApp::DATA_WIDTH_BYTES << " of " << data_size / HostApp::DATA_WIDTH_BYTES << " words." << endl;
+    set->data_size = offset;
+  }
+  stream_kernel(sink, batch_words);
 }
 
 void HW_Kernel::clean_kernel() {
   // This has to be modified by the user if the number (or name) of arguments is different
-  clReleaseMemObject(read_mem);
-  clReleaseMemObject(write_mem);
+  clFinish(commands);
+  for (int i = 0; i < HW_BUFFER_SETS; i++) {
+    if (buffer_sets[i].in_map) {clEnqueueUnmapMemObject(commands, buffer_sets[i].read_mem, buffer_sets[i].in_map, 0, NULL, NULL);}
+    if (buffer_sets[i].out_map) {clEnqueueUnmapMemObject(commands, buffer_sets[i].write_mem, buffer_sets[i].out_map, 0, NULL, NULL);}
+    release_events(buffer_sets[i]);
+    if (buffer_sets[i].read_mem) {clReleaseMemObject(buffer_sets[i].read_mem);}
+    if (buffer_sets[i].write_mem) {clReleaseMemObject(buffer_sets[i].write_mem);}
+    buffer_sets[i] = BufferSet();
+  }
+  device_bytes = 0;
 
   clReleaseProgram(program);
   clReleaseKernel(kernel);
@@ -54,6 +54,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define COLS 4096
 #define ROWS 4096
 
+// Default cap on the size of each device buffer (see initialize_kernel), and the smallest size allocated.
+#define DEFAULT_MAX_BUFFER_BYTES ((size_t)256 << 20)
+#define MIN_BUFFER_BYTES ((size_t)64 << 10)
+
+// Number of device buffer sets through which jobs are pipelined (2: ping-pong; 3: triple-buffered).
+#ifndef HW_BUFFER_SETS
+#define HW_BUFFER_SETS 2
+#endif
+
 
 class HW_Kernel : public Kernel {
 
@@ -67,8 +76,52 @@ public:
   cl_command_queue commands;          // compute command queue
   cl_program program;                 // compute programs
   cl_kernel kernel;                   // compute kernel
-  cl_mem read_mem;                    // device memory read by kernel
-  cl_mem write_mem;                   // device memory written by kernel
+
+  /*
+  ** A set of device buffers for one job in flight. Each job's upload, kernel execution, and readback are chained by
+  ** events, so, with the out-of-order queue, one job's transfers can overlap another job's compute in a different set.
+  ** Buffers are host-accessible, so they can also be mapped for zero-copy access (see map_input/map_output).
+  */
+  struct BufferSet {
+    cl_mem read_mem = NULL;           // device memory read by kernel
+    cl_mem write_mem = NULL;          // device memory written by kernel
+    size_t read_capacity = 0;         // allocated size of read_mem in bytes
+    size_t write_capacity = 0;        // allocated size of write_mem in bytes
+    cl_event write_done = NULL;       // input upload complete
+    cl_event kernel_done = NULL;      // kernel complete
+    int data_size = 0;                // size of the job's input in bytes
+    int resp_bytes = 0;               // size of the job's response in bytes
+    void * in_map = NULL;             // read_mem as mapped by map_input, or NULL
+    void * out_map = NULL;            // write_mem as mapped by map_output, or NULL
+  };
+  BufferSet buffer_sets[HW_BUFFER_SETS];
+  int load_set = 0;                   // set to receive the next job's input
+  int unload_set = 0;                 // set holding the oldest job whose response has not been read
+  int jobs_in_flight = 0;             // jobs started and not yet read
+  int resp_bytes = 0;                 // size of the response to the current request
+  size_t max_buffer_bytes = DEFAULT_MAX_BUFFER_BYTES;  // cap on the size of each device buffer
+  size_t device_bytes = 0;            // device memory currently allocated for buffers
+  size_t peak_device_bytes = 0;       // high-water mark of device_bytes
+  uint64_t buffer_grows = 0;          // number of buffer (re)allocations
+
+  /*
+  ** Per-phase latency histograms of jobs, from event profiling, reported by add_stats.
+  */
+  struct Profile {
+    LatencyHistogram write_dma;       // input upload
+    LatencyHistogram kernel;          // kernel execution
+    LatencyHistogram read_dma;        // response readback (all batches)
+    LatencyHistogram queue_wait;      // each command, from queued to start
+    LatencyHistogram write_to_kernel; // from upload end to kernel start
+    LatencyHistogram kernel_to_read;  // from kernel end to readback start
+    LatencyHistogram device_idle;     // from the previous job's readback end to this job's upload start (device time; 0 if they overlap)
+    LatencyHistogram total;           // from upload queued to readback end
+    cl_ulong last_read_end = 0;
+  } profile;
+  nlohmann::json init_phases_ms = nlohmann::json::object();  // duration of each phase of initialization
+  const char * platform_vendor = "Xilinx";  // vendor of the OpenCL platform to use (e.g. a CPU platform can stand in)
+  int device_index = 0;               // which of the matching devices to use
+  int num_devices_found = 0;          // number of matching devices (set by initialize_platform)
   int status = 1;
   bool initialized = false;
   static const int verbosity = 0; // 0: no debug messages; 10: all debug messages.
@@ -81,9 +134,10 @@ public:
   void perror(const char * msg);
 
   /*
-  ** Function to load the binary program in RAM in order to write it into the FPGA device
+  ** Function to map the binary program into memory (read-only) in order to write it into the FPGA device.
+  ** Returns NULL on failure. The mapping (of *size bytes) must be released with munmap.
   */
-  cl_uint load_file_to_memory(const char *filename, char **result);
+  const unsigned char * map_file_to_memory(const char *filename, size_t *size);
 
   
 
@@ -94,28 +148,35 @@ public:
   *****************************/
 
   /*
-  ** Initialize FPGA platform
+  ** Initialize FPGA platform. The platform is selected by platform_vendor. For a vendor other than Xilinx (a stand-in
+  ** platform), any device of the platform matches. Of the matching devices, the one at device_index is used.
   */
   void initialize_platform();
 
 
   /*
   ** Initialize the Kernel application.
-  ** Allocation of the memory space for the various arguments passed to the device
+  ** xclbin is the FPGA image, or, for a stand-in platform (see initialize_platform()), OpenCL C source (*.cl) of an
+  ** equivalent kernel (e.g. apps/vadd/host/vadd_standin.cl), which is built for the device.
+  ** Device buffers for the arguments are allocated as needed by each request, in power-of-two size classes from
+  ** MIN_BUFFER_BYTES, and are reused by subsequent requests. Each is limited to max_buffer_bytes (and the device's
+  ** maximum allocation); larger requests fail.
   */
-  void initialize_kernel(const char *xclbin, const char *kernel_name, int memory_size);
+  void initialize_kernel(const char *xclbin, const char *kernel_name, size_t max_buffer_bytes);
 
   /*
   ** Write data onto the board or device memory that will be consumed by the Kernel
   ** h_a_input: array containing data to be written on the device memory
   ** data_size: size of the data array in bytes
+  ** The upload is non-blocking, so the input must remain valid until the response is read. Up to HW_BUFFER_SETS
+  ** jobs may be written and started before their responses are read (in order).
   */
   void write_kernel_data(double h_a_input[], int data_size);
   void writeKernelData(void * input, int data_size, int resp_data_size);
   void write_kernel_data(input_struct * input, int data_size);
 
   /*
-  ** Starts the computation of the Kernel by injecting the "ap_start" signal
+  ** Starts the computation of the Kernel by injecting the "ap_start" signal once the job's input is uploaded.
   */
   void start_kernel();
 
@@ -123,8 +184,46 @@ public:
   ** Read data from the board or device memory. The data is produced by the Kernel
   ** h_a_output: array pointer on which data will be written
   ** data_size: size of data to be read by the kernel
+  ** Reads the response of the oldest job in flight, waiting only on that job's events.
+  */
+  int read_kernel_data(int h_a_output[], int data_size);
+
+  /*
+  ** Zero-copy access to the device buffers.
+  ** map_input returns the next job's input buffer to be filled in place. Passing it to writeKernelData then hands it
+  ** to the device without a copy.
+  ** map_output is an alternative to read_kernel_data that returns the oldest job's response in place. It remains valid
+  ** until passed to unmap_output, which must happen before the buffer set takes another job.
+  ** Both return NULL on error.
   */
-  void read_kernel_data(int h_a_output[], int data_size);
+  void * map_input(int data_size);
+  int * map_output(int data_size);
+  void unmap_output(void * output);
+  bool is_mapped_output(const void * output);
+
+  /*
+  ** Starts the computation and delivers the response to sink in batches. The response is transferred from device
+  ** memory once the kernel completes, so, unlike simulation, there is no early output, but the transfer is issued in
+  ** batches so that delivery of each batch overlaps transfer of the next.
+  */
+  void stream_kernel(KernelOutputSink &sink, int batch_words);
+  /*
+  ** As stream_kernel(..), but for the oldest job in flight, without starting one. With start_job(..), this allows a
+  ** job to be started before the previous job's response is read.
+  */
+  void stream_response(KernelOutputSink &sink, int batch_words);
+  /*
+  ** writeKernelData(..) and start_kernel(), returning false if the job could not be started (e.g. for a request
+  ** exceeding the device buffer cap, or with HW_BUFFER_SETS jobs already in flight).
+  */
+  bool start_job(void * input, int data_size, int resp_data_size);
+  /*
+  ** As above, but the input is taken from source, and each chunk is written to device memory as it arrives, while the
+  ** source receives the next. (The kernel itself starts once all input is in device memory.)
+  */
+  void stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words);
+  // The shell transfers exactly resp_data_size bytes of response (ignoring out_last), so the size must be bounded.
+  bool supports_unbounded() {return false;}
 
   /*
   ** Releases all the OpenCL components
@@ -133,6 +232,21 @@ public:
 
   void reset_kernel() {};
 
+  void add_stats(nlohmann::json &stats);
+
+private:
+  // Begins/ends a job in the current load/unload set, reporting (and returning NULL) if none is available.
+  BufferSet * load_buffer_set(int data_size, int resp_data_size);
+  BufferSet * unload_buffer_set();
+  void release_events(BufferSet &set);
+  // Ends the job in set, once read (via the given first and last read/map events, if successful).
+  void finish_job(BufferSet &set, cl_event first_read, cl_event last_read);
+  // Ensures mem (of the given capacity) holds at least bytes, (re)allocating it in the next size class if not.
+  bool fit_buffer(cl_mem &mem, size_t &capacity, size_t bytes, cl_mem_flags flags);
+  void profile_job(BufferSet &set, cl_event first_read, cl_event last_read);
+  // Uploads the input of the job in set, or unmaps it if it was mapped by map_input.
+  void upload(BufferSet &set, void * input, int data_size);
+
 };
 
 #endif
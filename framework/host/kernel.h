@@ -51,6 +51,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef HEADER_KERNEL
 #define HEADER_KERNEL
 
+#include <stdint.h>
+#include <stddef.h>
+#include <nlohmann/json.hpp>
+#include "latency_histogram.h"
+#include "word_layout.h"
+
 #define COLS 4096
 #define ROWS 4096
 
@@ -61,14 +67,75 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ** To be modified by the user if he sends different kind of data
 ** The following struct is specific to mandelbrot set calculation
 ** TODO: Doesn't belong here.
+** Each input_struct (an image "descriptor") is one 512-bit input word. A kernel launch may carry any number of
+** descriptors (consecutive input_structs), and the response is their images, concatenated.
 */
 typedef struct data_struct {
   double coordinates[4];
   long width;
   long height;
   long max_depth;
+  long reserved;  // Pads the descriptor to 512 bits.
 } input_struct;
 
+/*
+** The kernel's view of an input_struct (see mandelbrot_kernel.tlv), checked against the struct.
+*/
+namespace descriptor {
+  WORD_FIELD(min_x, double, 0, 64);
+  WORD_FIELD(min_y, double, 64, 64);
+  WORD_FIELD(pix_x, double, 128, 64);
+  WORD_FIELD(pix_y, double, 192, 64);
+  WORD_FIELD(img_size_x, long, 256, 64);
+  WORD_FIELD(img_size_y, long, 320, 64);
+  WORD_FIELD(max_depth, long, 384, 64);
+}
+typedef WordLayout<descriptor::min_x, descriptor::min_y, descriptor::pix_x, descriptor::pix_y,
+                   descriptor::img_size_x, descriptor::img_size_y, descriptor::max_depth> DescriptorWord;
+static_assert(sizeof(input_struct) * 8 == KERNEL_WORD_BITS &&
+              offsetof(input_struct, coordinates) * 8 == descriptor::min_x::offset &&
+              offsetof(input_struct, width) * 8 == descriptor::img_size_x::offset &&
+              offsetof(input_struct, height) * 8 == descriptor::img_size_y::offset &&
+              offsetof(input_struct, max_depth) * 8 == descriptor::max_depth::offset,
+              "input_struct does not match the kernel's descriptor word.");
+
+/*
+** The number of pixels (32-bit response words) of the images of the descriptors in data_size bytes of input.
+*/
+inline long input_struct_pixels(const input_struct * input, int data_size) {
+  long pixels = 0;
+  for (int i = 0; i < data_size / (int)sizeof(input_struct); i++) {
+    pixels += input[i].width * input[i].height;
+  }
+  return pixels;
+}
+
+
+/*
+** Receives kernel output as it is produced (see Kernel::stream_kernel(..)).
+*/
+class KernelOutputSink {
+public:
+  /*
+  ** data: the output data
+  ** data_words: the number of 512-bit words of data
+  */
+  virtual void consume(const uint32_t * data, int data_words) = 0;
+};
+
+
+/*
+** Provides kernel input as it arrives (see Kernel::stream_kernel(..)).
+*/
+class KernelInputSource {
+public:
+  /*
+  ** Return the next words of input, setting data_words to their number (of 512-bit words), or return NULL at the end
+  ** of the input. Blocks until input is available. The data remains valid until the next call.
+  */
+  virtual const uint32_t * produce(int &data_words) = 0;
+};
+
 
 class Kernel {
 
@@ -77,13 +144,72 @@ protected:
   bool initialized = false;
 
 public:
+  // resp_data_size for a response delimited only by the kernel (via out_last). Such a response must be received
+  // using stream_kernel(..).
+  static const int RESP_UNBOUNDED = -1;
+
+  virtual ~Kernel() {}
   virtual void perror(const char * msg) = 0;;
   virtual void reset_kernel() = 0;
+  /*
+  ** resp_data_size: the capacity for the response, in bytes. The kernel may end the response sooner by asserting
+  **                 out_last with its last word, or, if RESP_UNBOUNDED, only by doing so.
+  */
   virtual void writeKernelData(void * input, int data_size, int resp_data_size) = 0;
   virtual void write_kernel_data(input_struct * input, int data_size) = 0;
   virtual void start_kernel() = 0;
-  virtual void read_kernel_data(int h_a_output[], int data_size) = 0;
+  /*
+  ** Returns the number of bytes of response actually produced (<= data_size).
+  */
+  virtual int read_kernel_data(int h_a_output[], int data_size) = 0;
+  /*
+  ** An alternative to start_kernel() and read_kernel_data(..) which delivers output to sink in batches of up to
+  ** batch_words 512-bit words as it is produced, without buffering the full response.
+  */
+  virtual void stream_kernel(KernelOutputSink &sink, int batch_words) = 0;
+  /*
+  ** As writeKernelData(..) followed by stream_kernel(..), but the data_size bytes of input are taken from source as
+  ** they arrive, so the kernel can consume input while it is still being received, without buffering all of it.
+  */
+  virtual void stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words) = 0;
+  /*
+  ** Whether a response of RESP_UNBOUNDED size can be delivered.
+  */
+  virtual bool supports_unbounded() {return true;}
   virtual void clean_kernel() {};
+  /*
+  ** Make the kernel context of the given session current, creating it (in its reset state) if necessary and preserving
+  ** the context of the previous session. Kernels without context support share a single context.
+  */
+  virtual void select_session(const char * session) {};
+  /*
+  ** Discard the kernel context of the given session.
+  */
+  virtual void end_session(const char * session) {};
+  /*
+  ** Save the kernel context of the current session to a file, or restore it from one (as the starting context of new
+  ** sessions). Returns false if this fails or is not supported.
+  */
+  virtual bool save_checkpoint(const char * filename) {return false;};
+  virtual bool restore_checkpoint(const char * filename) {return false;};
+  /*
+  ** Load entries of a kernel memory directly (a "backdoor" load, bypassing the kernel's input), starting at address.
+  ** memory is the hierarchical name of the memory within the kernel. data is a JSON array with an element per entry:
+  ** a number, or an array of 32-bit words, least-significant first. Returns the number of entries written, or -1
+  ** with an explanation in error.
+  */
+  virtual int load_memory(const char * memory, int64_t address, const nlohmann::json &data, std::string &error) {
+    error = "This kernel does not support memory loads.";
+    return -1;
+  };
+  /*
+  ** Add kernel statistics (for the STATS command) to stats (a JSON object).
+  */
+  virtual void add_stats(nlohmann::json &stats) {};
+  /*
+  ** Add performance counters of the last transaction to perf (a JSON object), for kernels that have them.
+  */
+  virtual void add_perf(nlohmann::json &perf) {};
   virtual void enable_tracing() {};
   virtual void disable_tracing() {};
   virtual void save_trace() {};
@@ -0,0 +1,88 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** A histogram of latencies in power-of-two nanosecond buckets, for host statistics (see the STATS command).
+**
+*/
+
+#ifndef HEADER_LATENCY_HISTOGRAM
+#define HEADER_LATENCY_HISTOGRAM
+
+#include <stdint.h>
+#include <nlohmann/json.hpp>
+
+
+class LatencyHistogram {
+
+public:
+  static const int NUM_BUCKETS = 40;  // Bucket b counts latencies in [2^(b-1), 2^b) ns (bucket 0: 0 ns); the last catches all larger.
+
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t min_ns = UINT64_MAX;
+  uint64_t max_ns = 0;
+  uint64_t buckets[NUM_BUCKETS] = {};
+
+  void record(uint64_t ns) {
+    int b = 0;
+    while (b < NUM_BUCKETS - 1 && (ns >> b) != 0) {b++;}
+    buckets[b]++;
+    count++;
+    total_ns += ns;
+    if (ns < min_ns) {min_ns = ns;}
+    if (ns > max_ns) {max_ns = ns;}
+  }
+
+  /*
+  ** Summary in microseconds, with "buckets" as [[upper-bound-us, count], ...] for non-empty buckets.
+  */
+  nlohmann::json to_json() const {
+    nlohmann::json ret = {{"count", count}};
+    if (count) {
+      ret["mean_us"] = (double)total_ns / count / 1000.0;
+      ret["min_us"] = min_ns / 1000.0;
+      ret["max_us"] = max_ns / 1000.0;
+      nlohmann::json hist = nlohmann::json::array();
+      for (int b = 0; b < NUM_BUCKETS; b++) {
+        if (buckets[b]) {
+          hist.push_back({(double)((uint64_t)1 << b) / 1000.0, buckets[b]});
+        }
+      }
+      ret["buckets"] = hist;
+    }
+    return ret;
+  }
+};
+
+#endif
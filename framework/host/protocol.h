@@ -53,9 +53,30 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define CLEAN_KERNEL  "CLEAN_KERNEL"
 #define CLOSE_CONN    "CLOSE_CONN"
 #define GET_IMAGE     "GET_IMAGE"
+#define GET_IMAGES    "GET_IMAGES"  // Followed by a JSON array of GET_IMAGE parameter objects. The images are computed together
+                                    // (in as few kernel launches as possible), and each is sent, in order, as for GET_IMAGE.
 #define DATA_MSG      "DATA_MSG"  // Generic data message containing JSON array of 16-entry arrays of unsigned integer (32-bit) data to be sent to FPGA.
+                                  // With "perf": true, the response is {"data": [...], "perf": {<kernel performance counters>}}.
+                                  // Alternatively, {"jobs": [<DATA_MSG>, ...]} runs any number of independent jobs back to back,
+                                  // responding with an array of their responses. Each job is its own kernel transaction ("perf"
+                                  // covers the last job).
+#define STREAM_DATA_MSG "STREAM_DATA_MSG"  // As DATA_MSG, but the response is streamed as it is produced, as any number of
+                                           // DATA_MSG-style responses, of up to "batch" words each, followed by an empty response.
+#define UPLOAD_DATA_MSG "UPLOAD_DATA_MSG"  // As DATA_MSG, but the JSON has no "data"; the "size" words of input follow it as any number of
+                                           // size-prefixed binary messages of whole 512-bit words (little-endian 32-bit values),
+                                           // which are fed to the kernel as they arrive. Without a valid "size", the input cannot be
+                                           // delimited, so the host closes the connection.
 #define START_TRACING "START_TRACING"
 #define STOP_TRACING  "STOP_TRACING"
+#define SELECT_SESSION "SELECT_SESSION"  // Followed by a session ID string. Subsequent messages use the kernel context of this session.
+#define END_SESSION   "END_SESSION"  // Followed by a session ID string. Discards the kernel context of the session.
+#define STATS         "STATS"  // Responds with a JSON object of host statistics.
+#define SAVE_CHECKPOINT "SAVE_CHECKPOINT"  // Saves the kernel context of the current session to the host's checkpoint file
+                                           // (given by its command line), from which it starts next time.
+#define LOAD_MEMORY   "LOAD_MEMORY"  // Followed by JSON {"memory": <name within the kernel>, "address": <first entry>, "data": [<entry>, ...]},
+                                     // where each entry is a number or an array of 32-bit words (least-significant first). Writes
+                                     // the entries directly into a (public) memory of a simulated kernel. Responds with JSON
+                                     // {"entries": <count written>} or {"error": <message>}.
 
 
 #define INIT_PLATFORM_N   1
@@ -68,6 +89,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DATA_MSG_N        8
 #define START_TRACING_N   9
 #define STOP_TRACING_N    10
+#define STREAM_DATA_MSG_N 11
+#define SELECT_SESSION_N  12
+#define END_SESSION_N     13
+#define STATS_N           14
+#define SAVE_CHECKPOINT_N 15
+#define LOAD_MEMORY_N     16
+#define GET_IMAGES_N      17
+#define UPLOAD_DATA_MSG_N 18
 
 // Types of messages
 #define DATA_MSG "DATA_MSG"
@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "server_main.h"
+#include "http_front_end.h"
 #include "mandelbrot.h"
 
 using namespace std;
@@ -57,22 +58,87 @@ using namespace lodepng;
 
 int HostApp::server_main(int argc, char const *argv[], const char *kernel_name)
 {
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
 //TODO else ifndef OPENCL
 #ifdef OPENCL
-  string opencl_arg_str = " xclbin";
+  string opencl_arg_str = " [-v platform-vendor] [-M max-device-buffer-MB] [-d max-devices] xclbin";
   int opencl_arg_cnt = 1;
+  size_t max_buffer_bytes = DEFAULT_MAX_BUFFER_BYTES;
+  int max_devices = 0;  // 0 for all
 #else
   string opencl_arg_str = "";
   int opencl_arg_cnt = 0;
 #endif
+#ifdef SW_MODEL
+  string sw_model_arg_str = " [-m sw-model-lib]";
+  string sw_model_lib = "";
+  bool sw_model_required = false;  // True if explicitly given.
+  if (kernel_name != NULL) {
+    // Default to the model library alongside the executable.
+    string exe(argv[0]);
+    size_t slash = exe.find_last_of('/');
+    sw_model_lib = ((slash == string::npos) ? string(".") : exe.substr(0, slash)) + "/" + kernel_name + "_model.so";
+  }
+#else
+  string sw_model_arg_str = "";
+#endif
+#if defined(KERNEL_AVAIL) && !defined(OPENCL)
+  string sim_arg_str = " [-w trace-window-cycles] [-c checkpoint-file]";
+#else
+  string sim_arg_str = "";
+#endif
+  int http_port = 0;  // 0 for no HTTP front end.
+  string http_address = "127.0.0.1";  // Only local clients, unless given otherwise.
   // Poor-mans arg parsing.
   int argn = 1;
-  if (strcmp(argv[1], "-s") == 0) {
-    socket_filename = argv[2];
+  bool bad_args = false;
+  while (argn < argc && argv[argn][0] == '-') {
+    if (strcmp(argv[argn], "-H") == 0) {
+      BufferPool::shared().set_huge_pages(true);
+      argn += 1;
+      continue;
+    } else if (argn + 1 >= argc) {
+      bad_args = true;
+      break;
+    } else if (strcmp(argv[argn], "-s") == 0) {
+      socket_filename = argv[argn + 1];
+    } else if (strcmp(argv[argn], "-p") == 0) {
+      // [address:]port
+      const char * port_str = strrchr(argv[argn + 1], ':');
+      if (port_str) {
+        http_address = string(argv[argn + 1], port_str - argv[argn + 1]);
+        port_str++;
+      } else {
+        port_str = argv[argn + 1];
+      }
+      http_port = atoi(port_str);
+#ifdef OPENCL
+    } else if (strcmp(argv[argn], "-v") == 0) {
+      kernel.platform_vendor = argv[argn + 1];
+    } else if (strcmp(argv[argn], "-M") == 0) {
+      max_buffer_bytes = (size_t)atol(argv[argn + 1]) << 20;
+    } else if (strcmp(argv[argn], "-d") == 0) {
+      max_devices = atoi(argv[argn + 1]);
+#endif
+#ifdef SW_MODEL
+    } else if (strcmp(argv[argn], "-m") == 0) {
+      sw_model_lib = argv[argn + 1];
+      sw_model_required = true;
+#endif
+#if defined(KERNEL_AVAIL) && !defined(OPENCL)
+    } else if (strcmp(argv[argn], "-w") == 0) {
+      kernel.set_trace_window(strtoull(argv[argn + 1], NULL, 10));
+    } else if (strcmp(argv[argn], "-c") == 0) {
+      checkpoint_filename = argv[argn + 1];
+#endif
+    } else {
+      bad_args = true;
+      break;
+    }
     argn += 2;
   }
-  if (argc != argn + opencl_arg_cnt) {
-    printf("Usage: %s [-s socket] %s\n", argv[0], opencl_arg_str.c_str());
+  if (bad_args || argc != argn + opencl_arg_cnt) {
+    printf("Usage: %s [-s socket] [-p [http-address:]http-port]%s%s [-H]%s\n", argv[0], sw_model_arg_str.c_str(), sim_arg_str.c_str(), opencl_arg_str.c_str());
     return EXIT_FAILURE;
   }
 
@@ -124,45 +190,139 @@ int HostApp::server_main(int argc, char const *argv[], const char *kernel_name)
   }
 
 
+  if (http_port) {
+    http_front_end = new HttpFrontEnd(this);
+    if (!http_front_end->listen(http_address.c_str(), http_port)) {
+      perror("HTTP front end failed to listen");
+    }
+    cout_line() << "Serving HTTP on " << http_address << ":" << http_port << "." << endl;
+  }
+
+  startup_ms["listening"] = ms_since_start();
+
   #ifdef OPENCL
     // Platform initialization. These can also be initiated by commands over the socket (though I'm not sure how important that is).
-    init_platform(NULL);
-    init_kernel(NULL, xclbin, kernel_name, COLS * ROWS * sizeof(int));  // TODO: FIX size.
-  #endif
-
+    // This is slow, so it is done in the background, while requests are accepted (see wait_for_kernel()).
+    kernel_init_thread = thread([this, xclbin, kernel_name, max_buffer_bytes, max_devices]() {
+      init_platform(NULL);
+      init_kernel(NULL, xclbin, kernel_name, max_buffer_bytes);
+      kernel.reset_kernel();
+      // Open the other matching devices.
+      int devices = kernel.num_devices_found;
+      if (max_devices > 0 && devices > max_devices) {
+        devices = max_devices;
+      }
+      for (int d = 1; d < devices && !kernel.status; d++) {
+        HW_Kernel * k = new HW_Kernel();
+        k->platform_vendor = kernel.platform_vendor;
+        k->device_index = d;
+        k->initialize_platform();
+        if (!k->status) {
+          k->initialize_kernel(xclbin, kernel_name, max_buffer_bytes);
+        }
+        if (k->status) {
+          cerr_line() << "Failed to initialize device " << d << ". Using " << d << " device(s)." << endl;
+          delete k;
+          break;
+        }
+        k->initialized = true;
+        k->reset_kernel();
+        other_devices.push_back(k);
+      }
+      cout_line() << "Using " << num_devices() << " device(s)." << endl;
+      kernel_ready_ms = ms_since_start();
+      cout_line() << "Kernel ready " << kernel_ready_ms << " ms after startup." << endl;
+      kernel_initialized = true;
+    });
+  #else
   #ifdef KERNEL_AVAIL
     kernel.reset_kernel();
+    // Warm start from a checkpoint.
+    if (!checkpoint_filename.empty() && access(checkpoint_filename.c_str(), R_OK) == 0) {
+      if (kernel.restore_checkpoint(checkpoint_filename.c_str())) {
+        startup_ms["checkpoint_restored"] = ms_since_start();
+        cout_line() << "Restored checkpoint " << checkpoint_filename << " " << startup_ms["checkpoint_restored"] << " ms after startup." << endl;
+      } else {
+        cerr_line() << "Failed to restore checkpoint " << checkpoint_filename << ". Starting from reset." << endl;
+      }
+    }
+  #endif
+  #endif
+
+  #ifdef SW_MODEL
+    // Load the software model, if there is one.
+    if (sw_model_required || (!sw_model_lib.empty() && access(sw_model_lib.c_str(), R_OK) == 0)) {
+      sw_kernel.load_model(sw_model_lib.c_str());
+      if (!sw_kernel.initialized) {
+        cerr_line() << "Failed to load software model " << sw_model_lib << "." << endl;
+        exit(1);
+      }
+      sw_kernel.reset_kernel();
+    } else {
+      cout_line() << "No software model. Using default kernel behavior." << endl;
+    }
   #endif
 
+  startup_ms["initialized"] = ms_since_start();
 
+  // Serve the web server (once connected) and the HTTP front end (if any), one request at a time.
+  vector<struct pollfd> fds;
   while (true) {
-    if ((socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-      printf("%d\n", socket);
-      perror("SOCKET: Accept Failure");
-      exit(1);
+    fds.clear();
+    fds.push_back({(socket < 0) ? server_fd : socket, POLLIN, 0});
+    if (http_front_end) {http_front_end->add_poll_fds(fds);}
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {continue;}
+      perror("Poll failed");
     }
 
-    int loop_cnt = 0;
-    while(true) {
-      //cout << "C++ Main loop" << endl;
-      loop_cnt++;
-      if (loop_cnt > 10000) {
-        if (verbosity > 5) {cout << "." << flush;}
-        loop_cnt = 0;
+    if (fds[0].revents) {
+      if (socket < 0) {
+        if ((socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
+          printf("%d\n", socket);
+          perror("SOCKET: Accept Failure");
+          exit(1);
+        }
+      } else {
+        processTraffic();
       }
-
-      processTraffic();
     }
+    if (http_front_end) {http_front_end->service(fds, 1);}
   }
 
   return 0;
 }
 
 void HostApp::processTraffic() {
-  int command;
-
   string msg = socket_recv_string("command");
 
+  #ifdef KERNEL_AVAIL
+  // Restore the web server's session, if a local command selected another.
+  int command = get_command(msg.c_str());
+  if (socket_session_stale && command != SELECT_SESSION_N && command != END_SESSION_N) {
+    kernel.select_session(socket_session.c_str());
+    socket_session_stale = false;
+  }
+  #endif
+
+  process_command(msg);
+}
+
+void HostApp::process_local(const char * command, LocalChannel &channel, const char * session) {
+  #ifdef KERNEL_AVAIL
+  if (session) {
+    kernel.select_session(session);
+    socket_session_stale = true;
+  }
+  #endif
+  local = &channel;
+  process_command(command);
+  local = NULL;
+}
+
+void HostApp::process_command(const string &msg) {
+  int command;
+
   //cout << "Main loop" << "Msg: " << msg << endl;
 
   // Translate message to an integer
@@ -174,7 +334,7 @@ void HostApp::processTraffic() {
   struct timespec start, end;
 
   // getting start time
-  if (verbosity > 2) {clock_gettime(CLOCK_MONOTONIC_RAW, &start);}
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
   switch( command ) {
     case GET_IMAGE_N:
@@ -183,88 +343,18 @@ void HostApp::processTraffic() {
         get_image();
       }
       break;
+    case GET_IMAGES_N:
+      get_images();
+      break;
     case DATA_MSG_N:
-      {  // Provides scope for local variables.
-        // Get JSON data.
-        json data_json = socket_recv_json("DATA");
-        try {
-          const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
-          // Allocate in/out data buffers.
-          size_t size = data_json["size"];
-          size_t resp_size = data_json["resp_size"];
-          uint32_t * int_data_p = (uint32_t *)malloc(size * DATA_WIDTH_BYTES);
-          uint32_t * int_resp_data_p = (uint32_t *)malloc(resp_size * DATA_WIDTH_BYTES); {
-            // With these data arrays...
-
-            // Initial data for arrays (debug only).
-            for (uint i = 0; i < size * DATA_WIDTH_UINT32; i++) {
-              int_data_p[i] = 0xDEADBEEF;
-            }
-            for (uint i = 0; i < resp_size * DATA_WIDTH_UINT32; i++) {
-              int_resp_data_p[i] = 0xBEEFCAFE;
-            }
-
-            cout_line() << "Extracting data from JSON structure." << endl;
-            // Populate from JSON.
-            for (unsigned int d = 0; d < size; d++) {
-              for (int i = 0; i < DATA_WIDTH_UINT32; i++) {
-                uint32_t val = data_json["data"][d][i];
-                int_data_p[d * DATA_WIDTH_UINT32 + i] = val;
-                if (verbosity > 1) {cout_line() << "Set data[" << d << "][" << i << "] to " << hex << val << dec << endl;}
-              }
-            }
-            cout_line() << "Done extracting data." << endl;
-
-            // Send data to FPGA, or do fake FPGA processing.
-            #ifdef KERNEL_AVAIL
-            // Process in FPGA.
-            kernel.writeKernelData(int_data_p, size * DATA_WIDTH_BYTES, resp_size * DATA_WIDTH_BYTES);
-            if (verbosity > 2) {cout << "Wrote kernel." << endl;}
-
-
-            kernel.start_kernel();
-            if (verbosity > 2) {cout << "Started kernel." << endl;}
-
-            if (verbosity > 2) {cout << "Reading kernel data (" << resp_size * DATA_WIDTH_BYTES << " bytes)." << endl;}
-            kernel.read_kernel_data((int *)int_resp_data_p, resp_size * DATA_WIDTH_BYTES);
-            if (verbosity > 3) {cout << "Read kernel data (" << resp_size * DATA_WIDTH_BYTES << " bytes)." << endl;}
-            #else
-            // Fake the kernel.
-            fakeKernel(size * DATA_WIDTH_BYTES, int_data_p, resp_size * DATA_WIDTH_BYTES, int_resp_data_p);
-            #endif
-
-            // Convert data to JSON.
-            string s("");
-            //s += "{\"size\":";
-            //s += to_string(resp_size);
-            //s += ",\"data\":";
-            cout_line() << "Kernel produced:" << endl;
-            s += "[";
-            for (unsigned int d = 0; d < resp_size; d++) {
-              if (d > 0) {s += ",";}
-              s += "[";
-              for (int i = 0; i < DATA_WIDTH_UINT32; i++) {
-                if (i > 0) {s += ",";}
-                uint32_t val = int_resp_data_p[d * DATA_WIDTH_UINT32 + i];
-                s += to_string(val);
-                if (verbosity > 1) {cout_line() << "Read data[" << d << "][" << i << "] == " << hex << val << dec << endl;}
-              }
-              s += "]";
-            }
-            s += "]";
-            //s += "}";
-
-            // Respond.
-            if (verbosity > 5) {cout_line() << "Responding with: " << s << endl;}
-            socket_send("DATA response", s);
-
-          } free(int_resp_data_p); free(int_data_p);
-        } catch (nlohmann::detail::exception) {
-          cerr_line() << "Unable to process DATA message." << endl;
-          exit(1);
-        }
-        break;
-      }
+      handle_data_msg(false);
+      break;
+    case STREAM_DATA_MSG_N:
+      handle_data_msg(true);
+      break;
+    case UPLOAD_DATA_MSG_N:
+      handle_upload_data_msg();
+      break;
       case START_TRACING_N:
       {
         //json data_json = socket_recv_json("START TRACING");
@@ -275,6 +365,47 @@ void HostApp::processTraffic() {
         //socket_send("START_TRACING Response", string("\"START_TRACING ACK\""));
         break;
       }
+      case SELECT_SESSION_N:
+      {
+        string session = socket_recv_string("session");
+        #ifdef KERNEL_AVAIL
+        kernel.select_session(session.c_str());
+        #endif
+        if (!local) {
+          socket_session = session;
+          socket_session_stale = false;
+        }
+        break;
+      }
+      case END_SESSION_N:
+      {
+        string session = socket_recv_string("session");
+        #ifdef KERNEL_AVAIL
+        kernel.end_session(session.c_str());
+        #endif
+        if (!local && session == socket_session) {
+          socket_session = "";
+        }
+        break;
+      }
+      case STATS_N:
+        handle_stats();
+        break;
+      case LOAD_MEMORY_N:
+        handle_load_memory();
+        break;
+      case SAVE_CHECKPOINT_N:
+      {
+        #ifdef KERNEL_AVAIL
+        if (checkpoint_filename.empty()) {
+          cerr_line() << "No checkpoint file was given (-c) for SAVE_CHECKPOINT." << endl;
+        } else {
+          wait_for_kernel();
+          kernel.save_checkpoint(checkpoint_filename.c_str());
+        }
+        #endif
+        break;
+      }
       case STOP_TRACING_N:
       {
         //json data_json = socket_recv_json("START TRACING");
@@ -300,22 +431,693 @@ void HostApp::processTraffic() {
       #endif
   }
 
+  // getting end time
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  uint64_t delta_ns = (end.tv_sec - start.tv_sec) * 1000000000ull + (end.tv_nsec - start.tv_nsec);
+  command_latency[msg].record(delta_ns);
+
   if (verbosity > 2) {
-    // getting end time
-    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("Kernel execution time %s: %ld [us]\n", msg.c_str(), delta_ns / 1000);
+  }
+}
+
+double HostApp::ms_since_start() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time.tv_sec) * 1000.0 + (now.tv_nsec - start_time.tv_nsec) / 1000000.0;
+}
 
-    uint64_t delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
-    printf("Kernel execution time %s: %ld [us]\n", msg.c_str(), delta_us);
+bool HostApp::kernel_ready() {
+  #ifdef OPENCL
+  return kernel_initialized;
+  #else
+  return true;
+  #endif
+}
+
+void HostApp::wait_for_kernel() {
+  #ifdef OPENCL
+  if (kernel_init_thread.joinable()) {
+    if (!kernel_initialized) {
+      cout_line() << "Waiting for kernel initialization." << endl;
+    }
+    kernel_init_thread.join();
   }
+  #endif
 }
 
-// Default fake server is an echo server.
-void HostApp::fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer) {
-  if (bytes_out != bytes_in) {
-    cerr_line() << "Default Echo server expects bytes_out (" << bytes_out << ") == bytes_in (" << bytes_in << "). Exiting." << endl;
-    exit(1);
+void HostApp::handle_stats() {
+  json stats = json::object();
+  stats["startup_ms"] = startup_ms;
+  if (kernel_ready()) {
+    #ifdef OPENCL
+    stats["startup_ms"]["kernel_ready"] = kernel_ready_ms;
+    #endif
+  }
+  for (auto &cmd : command_latency) {
+    stats["commands"][cmd.first] = cmd.second.to_json();
+  }
+  BufferPool &pool = BufferPool::shared();
+  stats["buffer_pool"] = {{"hits", pool.hits}, {"misses", pool.misses}};
+  // Memory footprint of the host process.
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats["process"]["peak_rss_bytes"] = (uint64_t)usage.ru_maxrss * 1024;
+  }
+  FILE * statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    unsigned long size_pages, rss_pages;
+    if (fscanf(statm, "%lu %lu", &size_pages, &rss_pages) == 2) {
+      stats["process"]["rss_bytes"] = (uint64_t)rss_pages * sysconf(_SC_PAGESIZE);
+    }
+    fclose(statm);
+  }
+  #ifdef KERNEL_AVAIL
+  // (Not until initialized, since the kernel is not thread-safe.)
+  if (kernel_ready()) {
+    stats["kernel"] = json::object();
+    kernel.add_stats(stats["kernel"]);
+    #ifdef OPENCL
+    // Each additional device.
+    for (int d = 1; d < num_devices(); d++) {
+      json device_stats = json::object();
+      device(d).add_stats(device_stats);
+      stats["other_devices"].push_back(device_stats);
+    }
+    #endif
+  }
+  #endif
+  #ifdef SW_MODEL
+  stats["sw_kernel"] = json::object();
+  sw_kernel.add_stats(stats["sw_kernel"]);
+  #endif
+  socket_send("STATS response", stats.dump());
+}
+
+void HostApp::handle_load_memory() {
+  json request = socket_recv_json("LOAD_MEMORY");
+  json response = json::object();
+  string error = "No kernel.";
+  int entries = -1;
+  #ifdef KERNEL_AVAIL
+  wait_for_kernel();
+  if (request.is_object() && request.count("memory") && request["memory"].is_string() && request.count("data") &&
+      (!request.count("address") || request["address"].is_number_integer())) {
+    int64_t address = request.value("address", (int64_t)0);
+    entries = kernel.load_memory(request["memory"].get<string>().c_str(), address, request["data"], error);
+  } else {
+    error = "LOAD_MEMORY requires \"memory\" and \"data\".";
+  }
+  #endif
+  if (entries < 0) {
+    cerr_line() << "LOAD_MEMORY failed: " << error << endl;
+    response["error"] = error;
+  } else {
+    if (verbosity > 1) {cout_line() << "Loaded " << entries << " entries of memory " << request["memory"].get<string>() << "." << endl;}
+    response["entries"] = entries;
+  }
+  socket_send("LOAD_MEMORY response", response.dump());
+}
+
+// Default fake server uses the software model, if loaded, or is an echo server.
+size_t HostApp::fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer) {
+#ifdef SW_MODEL
+  if (sw_kernel.initialized) {
+    sw_kernel.writeKernelData(in_buffer, bytes_in, bytes_out);
+    sw_kernel.start_kernel();
+    return sw_kernel.read_kernel_data((int *)out_buffer, bytes_out);
+  }
+#endif
+  if (bytes_out < bytes_in) {
+    cerr_line() << "Default Echo server expects bytes_out (" << bytes_out << ") >= bytes_in (" << bytes_in << "). Truncating." << endl;
+    bytes_in = bytes_out;
   }
   memcpy(out_buffer, in_buffer, bytes_in);
+  return bytes_in;
+}
+
+void HostApp::fakeKernelStream(size_t bytes_in, void * in_buffer, int bytes_out, KernelOutputSink &sink, int batch_words) {
+#ifdef SW_MODEL
+  if (sw_kernel.initialized) {
+    sw_kernel.writeKernelData(in_buffer, bytes_in, bytes_out);
+    sw_kernel.stream_kernel(sink, batch_words);
+    return;
+  }
+#endif
+  // No incremental model; produce the full response, then deliver it in batches.
+  // The echo server's response is never larger than its input.
+  if (bytes_out < 0) {bytes_out = bytes_in;}
+  const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+  uint32_t * out_buffer = (uint32_t *)BufferPool::shared().alloc(bytes_out);
+  int resp_words = fakeKernel(bytes_in, in_buffer, bytes_out, out_buffer) / DATA_WIDTH_BYTES;
+  for (int d = 0; d < resp_words; d += batch_words) {
+    sink.consume(&out_buffer[d * DATA_WIDTH_UINT32], (resp_words - d < batch_words) ? resp_words - d : batch_words);
+  }
+  BufferPool::shared().release(out_buffer);
+}
+
+void HostApp::fakeKernelStream(KernelInputSource &source, size_t bytes_in, int bytes_out, KernelOutputSink &sink, int batch_words) {
+#ifdef SW_MODEL
+  if (sw_kernel.initialized) {
+    sw_kernel.stream_kernel(source, bytes_in, bytes_out, sink, batch_words);
+    return;
+  }
+#endif
+  char * in_buffer = (char *)BufferPool::shared().alloc(bytes_in);
+  size_t bytes = 0;
+  int words;
+  const uint32_t * data;
+  while (bytes < bytes_in && (data = source.produce(words)) != NULL) {
+    memcpy(&in_buffer[bytes], data, words * DATA_WIDTH_BYTES);
+    bytes += words * DATA_WIDTH_BYTES;
+  }
+  fakeKernelStream(bytes, in_buffer, bytes_out, sink, batch_words);
+  BufferPool::shared().release(in_buffer);
+}
+
+void HostApp::DataMsgSender::consume(const uint32_t * data, int data_words) {
+  string s = app->data_to_json(data, data_words);
+  if (verbosity > 5) {app->cout_line() << "Streaming: " << s << endl;}
+  app->socket_send("STREAM_DATA response", s);
+}
+
+void HostApp::DataMsgCollector::consume(const uint32_t * data, int data_words) {
+  const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+  if (this->data_words + data_words > capacity_words) {
+    // Grow geometrically.
+    while (this->data_words + data_words > capacity_words) {
+      capacity_words = capacity_words ? capacity_words * 2 : data_words;
+    }
+    uint32_t * grown = (uint32_t *)BufferPool::shared().alloc(capacity_words * DATA_WIDTH_BYTES);
+    memcpy(grown, this->data, this->data_words * DATA_WIDTH_BYTES);
+    BufferPool::shared().release(this->data);
+    this->data = grown;
+  }
+  memcpy(&this->data[this->data_words * DATA_WIDTH_UINT32], data, data_words * DATA_WIDTH_BYTES);
+  this->data_words += data_words;
+}
+
+HostApp::SocketInputSource::SocketInputSource(HostApp * app, size_t data_words) : app(app), data_bytes(data_words * DATA_WIDTH_BYTES) {
+  for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+    buffers[i] = (uint32_t *)BufferPool::shared().alloc(UPLOAD_BUFFER_BYTES);
+  }
+  receiver = thread(&SocketInputSource::receive, this);
+}
+
+HostApp::SocketInputSource::~SocketInputSource() {
+  drain();
+  for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+    BufferPool::shared().release(buffers[i]);
+  }
+}
+
+bool HostApp::SocketInputSource::drain() {
+  if (receiver.joinable()) {
+    {
+      lock_guard<mutex> lock(m);
+      abandoned = true;
+    }
+    cv.notify_all();
+    receiver.join();
+  }
+  return !failed;
+}
+
+void HostApp::SocketInputSource::receive() {
+  size_t bytes_left = data_bytes;
+  size_t msg_bytes_left = 0;
+  // (Once failed, a message may exceed the given size.)
+  while (bytes_left > 0 || msg_bytes_left > 0) {
+    if (msg_bytes_left == 0) {
+      msg_bytes_left = app->socket_recv_size("upload data");
+      if (!failed && (msg_bytes_left % DATA_WIDTH_BYTES != 0 || msg_bytes_left > bytes_left)) {
+        app->cerr_line() << "UPLOAD_DATA_MSG data must be whole words, totaling the given size." << endl;
+        // The input ends here.
+        {
+          lock_guard<mutex> lock(m);
+          failed = true;
+        }
+        cv.notify_all();
+      }
+      continue;
+    }
+    if (failed) {
+      // Receive and discard the remaining data, as framed by the client, so the socket remains in sync.
+      char discard[4096];
+      size_t bytes = (msg_bytes_left < sizeof(discard)) ? msg_bytes_left : sizeof(discard);
+      app->socket_recv("upload data", discard, bytes);
+      msg_bytes_left -= bytes;
+      bytes_left -= (bytes < bytes_left) ? bytes : bytes_left;
+      continue;
+    }
+    // Await a free buffer (or, once abandoned, overwrite any buffer).
+    int b;
+    {
+      unique_lock<mutex> lock(m);
+      cv.wait(lock, [this]{return filled - done < UPLOAD_BUFFERS || abandoned;});
+      b = filled % UPLOAD_BUFFERS;
+    }
+    size_t bytes = (msg_bytes_left < (size_t)UPLOAD_BUFFER_BYTES) ? msg_bytes_left : UPLOAD_BUFFER_BYTES;
+    app->socket_recv("upload data", buffers[b], bytes);
+    msg_bytes_left -= bytes;
+    bytes_left -= bytes;
+    {
+      lock_guard<mutex> lock(m);
+      buffer_words[b] = bytes / DATA_WIDTH_BYTES;
+      filled++;
+    }
+    cv.notify_all();
+  }
+  {
+    lock_guard<mutex> lock(m);
+    received = true;
+  }
+  cv.notify_all();
+}
+
+const uint32_t * HostApp::SocketInputSource::produce(int &data_words) {
+  unique_lock<mutex> lock(m);
+  // The previously produced buffer is done.
+  done = produced;
+  cv.notify_all();
+  cv.wait(lock, [this]{return produced < filled || received || failed;});
+  if (produced == filled || failed) {
+    return NULL;
+  }
+  int b = produced++ % UPLOAD_BUFFERS;
+  data_words = buffer_words[b];
+  return buffers[b];
+}
+
+void HostApp::json_to_data(const json &data_json, size_t data_words, uint32_t * data) {
+  const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+  for (unsigned int d = 0; d < data_words; d++) {
+    for (int i = 0; i < DATA_WIDTH_UINT32; i++) {
+      uint32_t val = data_json.at(d).at(i);
+      data[d * DATA_WIDTH_UINT32 + i] = val;
+      if (verbosity > 1) {cout_line() << "Set data[" << d << "][" << i << "] to " << hex << val << dec << endl;}
+    }
+  }
+}
+
+string HostApp::data_to_json(const uint32_t * data, int data_words) {
+  const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+  if (verbosity > 1) {
+    for (int d = 0; d < data_words * DATA_WIDTH_UINT32; d++) {
+      cout_line() << "Read data[" << d / DATA_WIDTH_UINT32 << "][" << d % DATA_WIDTH_UINT32 << "] == " << hex << data[d] << dec << endl;
+    }
+  }
+  string s;
+  DataMsgJson::append_json(s, data, data_words);
+  return s;
+}
+
+void HostApp::handle_data_msg(bool stream) {
+  // Get JSON data. A typical message is parsed by DataMsgJson, directly into the kernel's input buffer. Others, like
+  // DATA_MSG jobs, are parsed generally.
+  char * msg = socket_recv_c_string("DATA");
+  wait_for_kernel();
+  DataMsgJson fields;
+  bool in_place = fields.parse_header(msg);
+  json data_json;
+  try {
+    if (!in_place) {
+      data_json = json::parse(msg);
+      if (!stream && data_json.count("jobs")) {
+        free(msg);
+        handle_data_jobs(data_json);
+        return;
+      }
+      fields.read_fields(data_json);
+    }
+  } catch (const nlohmann::detail::exception &) {
+    free(msg);
+    respond_with_error("Unable to process DATA message.", stream);
+    return;
+  }
+  // Each word of data takes at least 33 characters, so this also bounds the allocation below by the message length.
+  if (fields.size < 0 || (size_t)fields.size > strlen(msg) / 33) {
+    free(msg);
+    respond_with_error("DATA message \"size\" does not match its data.", stream);
+    return;
+  }
+  #ifdef OPENCL
+  // Spread requests over devices.
+  HW_Kernel &kernel = next_device();
+  #endif
+  try {
+    // Allocate in/out data buffers.
+    size_t size = fields.size;
+    BufferPool &pool = BufferPool::shared();
+    #ifdef OPENCL
+    // Populate the kernel's (host-accessible) input buffer in place, if possible.
+    uint32_t * mapped_data_p = (uint32_t *)kernel.map_input(size * DATA_WIDTH_BYTES);
+    uint32_t * int_data_p = mapped_data_p ? mapped_data_p : (uint32_t *)pool.alloc(size * DATA_WIDTH_BYTES);
+    #else
+    uint32_t * mapped_data_p = NULL;
+    uint32_t * int_data_p = (uint32_t *)pool.alloc(size * DATA_WIDTH_BYTES);
+    #endif
+
+    #ifdef DEBUG
+    // Initial data for arrays (debug only).
+    const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+    for (uint i = 0; i < size * DATA_WIDTH_UINT32; i++) {
+      int_data_p[i] = 0xDEADBEEF;
+    }
+    #endif
+
+    cout_line() << "Extracting data from JSON structure." << endl;
+    // Populate from JSON. (If the message turns out not to have the expected form, parse it generally.)
+    if (!in_place || !fields.parse_data(int_data_p)) {
+      bool ok = true;
+      try {
+        if (in_place) {
+          data_json = json::parse(msg);
+          fields.read_fields(data_json);
+        }
+        ok = fields.size == (long)size;
+        if (ok) {json_to_data(data_json.at("data"), size, int_data_p);}
+      } catch (const nlohmann::detail::exception &) {
+        ok = false;
+      }
+      if (!ok) {
+        free(msg);
+        // (A mapped input simply remains mapped for the next request.)
+        if (!mapped_data_p) {pool.release(int_data_p);}
+        respond_with_error("Unable to process DATA message.", stream);
+        return;
+      }
+    }
+    free(msg);
+    cout_line() << "Done extracting data." << endl;
+
+    // resp_size is the capacity for the response, which the kernel may end sooner (via out_last). Without it, the
+    // response is delimited only by the kernel, and it is collected in a buffer that grows as needed.
+    int resp_bytes;
+    string error = to_resp_bytes(fields.resp_size, resp_bytes);
+    if (!error.empty()) {
+      // (A mapped input simply remains mapped for the next request.)
+      if (!mapped_data_p) {pool.release(int_data_p);}
+      respond_with_error(error, stream);
+      return;
+    }
+    bool bounded = resp_bytes != Kernel::RESP_UNBOUNDED;
+    int batch_words = DEFAULT_STREAM_BATCH;
+    if (stream && fields.batch >= 0) {
+      batch_words = fields.batch;
+      if (batch_words < 1) {batch_words = 1;}
+    }
+    // With "perf": true, the (non-streamed) response includes the kernel's performance counters for the request, as
+    // {"data": [...], "perf": {...}}.
+    bool with_perf = !stream && fields.perf;
+    auto add_perf = [&](string &resp) {
+      json perf = json::object();
+      #ifdef KERNEL_AVAIL
+      kernel.add_perf(perf);
+      #endif
+      resp = "{\"data\": " + resp + ", \"perf\": " + perf.dump() + "}";
+    };
+    // A streamed or unbounded response is delivered in batches, so no full response buffer is needed.
+    // For OpenCL, the response is converted in place in the kernel's output buffer.
+    bool batched = stream || !bounded;
+    #ifdef OPENCL
+    uint32_t * int_resp_data_p = NULL; {
+    #else
+    uint32_t * int_resp_data_p = batched ? NULL : (uint32_t *)pool.alloc(resp_bytes);
+    if (!batched && !int_resp_data_p) {
+      if (!mapped_data_p) {pool.release(int_data_p);}
+      respond_with_error("Unable to allocate the DATA message response.");
+      return;
+    } {
+    #endif
+      // With these data arrays...
+
+      #ifdef DEBUG
+      if (int_resp_data_p) {
+        for (int i = 0; i < resp_bytes / 4; i++) {
+          int_resp_data_p[i] = 0xBEEFCAFE;
+        }
+      }
+      #endif
+
+      if (batched) {
+        // Send each batch of output as it is produced, then an empty response to terminate, or collect the batches
+        // into a single response.
+        DataMsgSender sender(this);
+        DataMsgCollector collector;
+        KernelOutputSink &sink = stream ? (KernelOutputSink &)sender : (KernelOutputSink &)collector;
+        #ifdef KERNEL_AVAIL
+        kernel.writeKernelData(int_data_p, size * DATA_WIDTH_BYTES, resp_bytes);
+        kernel.stream_kernel(sink, batch_words);
+        #else
+        fakeKernelStream(size * DATA_WIDTH_BYTES, int_data_p, resp_bytes, sink, batch_words);
+        #endif
+        if (stream) {
+          socket_send("STREAM_DATA end", string(""));
+        } else {
+          cout_line() << "Kernel produced " << collector.data_words << " words." << endl;
+          string s = data_to_json(collector.data, collector.data_words);
+          if (with_perf) {add_perf(s);}
+          if (verbosity > 5) {cout_line() << "Responding with: " << s << endl;}
+          socket_send("DATA response", s);
+        }
+      } else {
+        // Send data to FPGA, or do fake FPGA processing.
+        #ifdef KERNEL_AVAIL
+        // Process in FPGA.
+        kernel.writeKernelData(int_data_p, size * DATA_WIDTH_BYTES, resp_bytes);
+        if (verbosity > 2) {cout << "Wrote kernel." << endl;}
+
+
+        kernel.start_kernel();
+        if (verbosity > 2) {cout << "Started kernel." << endl;}
+
+        if (verbosity > 2) {cout << "Reading kernel data (up to " << resp_bytes << " bytes)." << endl;}
+        #ifdef OPENCL
+        int_resp_data_p = (uint32_t *)kernel.map_output(resp_bytes);
+        if (!int_resp_data_p) {resp_bytes = 0;}
+        #else
+        resp_bytes = kernel.read_kernel_data((int *)int_resp_data_p, resp_bytes);
+        #endif
+        if (verbosity > 3) {cout << "Read kernel data (" << resp_bytes << " bytes)." << endl;}
+        #else
+        // Fake the kernel.
+        resp_bytes = fakeKernel(size * DATA_WIDTH_BYTES, int_data_p, resp_bytes, int_resp_data_p);
+        #endif
+
+        // Convert data to JSON.
+        cout_line() << "Kernel produced:" << endl;
+        string s = data_to_json(int_resp_data_p, resp_bytes / DATA_WIDTH_BYTES);
+        if (with_perf) {add_perf(s);}
+
+        // Respond.
+        if (verbosity > 5) {cout_line() << "Responding with: " << s << endl;}
+        socket_send("DATA response", s);
+        #ifdef OPENCL
+        if (int_resp_data_p) {kernel.unmap_output(int_resp_data_p);}
+        int_resp_data_p = NULL;
+        #endif
+      }
+
+    } pool.release(int_resp_data_p);
+    // A mapped input was handed to the kernel.
+    if (!mapped_data_p) {pool.release(int_data_p);}
+  } catch (const nlohmann::detail::exception &) {
+    respond_with_error("Unable to process DATA message.", stream);
+  }
+}
+
+void HostApp::handle_data_jobs(json &data_json) {
+  #ifdef OPENCL
+  HW_Kernel &kernel = next_device();
+  #endif
+  try {
+    const int DATA_WIDTH_UINT32 = DATA_WIDTH_BYTES / 4;
+    json &jobs = data_json["jobs"];
+    size_t cnt = jobs.size();
+    // Inputs of all jobs, back to back.
+    vector<size_t> sizes(cnt);
+    vector<int> resp_bytes(cnt);
+    size_t total_size = 0;
+    for (size_t j = 0; j < cnt; j++) {
+      long size = DataMsgJson::field(jobs[j], "size");
+      if (size < 0 || (size_t)size > jobs[j].at("data").size()) {
+        respond_with_error("DATA message job \"size\" does not match its data.");
+        return;
+      }
+      string error = to_resp_bytes(DataMsgJson::field(jobs[j], "resp_size"), resp_bytes[j]);
+      if (!error.empty()) {
+        respond_with_error(error);
+        return;
+      }
+      sizes[j] = size;
+      total_size += sizes[j];
+    }
+    uint32_t * int_data_p = (uint32_t *)BufferPool::shared().alloc(total_size * DATA_WIDTH_BYTES);
+    uint32_t * job_data_p = int_data_p;
+    try {
+      for (size_t j = 0; j < cnt; j++) {
+        json_to_data(jobs[j]["data"], sizes[j], job_data_p);
+        job_data_p += sizes[j] * DATA_WIDTH_UINT32;
+      }
+    } catch (const nlohmann::detail::exception &) {
+      BufferPool::shared().release(int_data_p);
+      throw;
+    }
+
+    // Run the jobs, collecting each job's response as an offset (in words) into one collector.
+    DataMsgCollector collector;
+    vector<int> resp_offsets(cnt + 1, 0);
+    #ifdef OPENCL
+    // Each job is its own transaction (all bounded, as ensured by to_resp_bytes(..)). Up to HW_BUFFER_SETS are in flight: the next
+    // jobs are uploaded and started before each job's response is read, so transfers overlap the kernel.
+    size_t started = 0;
+    job_data_p = int_data_p;
+    bool ok = true;
+    for (size_t j = 0; j < cnt; j++) {
+      while (ok && started < cnt && started < j + HW_BUFFER_SETS) {
+        ok = kernel.start_job(job_data_p, sizes[started] * DATA_WIDTH_BYTES, resp_bytes[started]);
+        if (ok) {
+          job_data_p += sizes[started] * DATA_WIDTH_UINT32;
+          started++;
+        }
+      }
+      if (j == started) {
+        break;
+      }
+      kernel.stream_response(collector, DEFAULT_STREAM_BATCH);
+      resp_offsets[j + 1] = collector.data_words;
+    }
+    if (!ok) {
+      // (The jobs that were started have been read.)
+      BufferPool::shared().release(int_data_p);
+      respond_with_error("The kernel failed to run DATA message job " + to_string(started) + ".");
+      return;
+    }
+    #else
+    // Each job is its own transaction, delimited by its resp_size or by the kernel (out_last or quiescence).
+    job_data_p = int_data_p;
+    for (size_t j = 0; j < cnt; j++) {
+      #ifdef KERNEL_AVAIL
+      kernel.writeKernelData(job_data_p, sizes[j] * DATA_WIDTH_BYTES, resp_bytes[j]);
+      kernel.stream_kernel(collector, DEFAULT_STREAM_BATCH);
+      #else
+      fakeKernelStream(sizes[j] * DATA_WIDTH_BYTES, job_data_p, resp_bytes[j], collector, DEFAULT_STREAM_BATCH);
+      #endif
+      job_data_p += sizes[j] * DATA_WIDTH_UINT32;
+      resp_offsets[j + 1] = collector.data_words;
+    }
+    #endif
+    BufferPool::shared().release(int_data_p);
+    cout_line() << "Kernel produced " << collector.data_words << " words for " << cnt << " jobs." << endl;
+
+    // Respond with an array of the jobs' responses.
+    string s("[");
+    for (size_t j = 0; j < cnt; j++) {
+      if (j > 0) {s += ",";}
+      s += data_to_json(&collector.data[resp_offsets[j] * DATA_WIDTH_UINT32], resp_offsets[j + 1] - resp_offsets[j]);
+    }
+    s += "]";
+    if (data_json.count("perf") && (bool)data_json["perf"]) {
+      json perf = json::object();
+      #ifdef KERNEL_AVAIL
+      kernel.add_perf(perf);
+      #endif
+      s = "{\"data\": " + s + ", \"perf\": " + perf.dump() + "}";
+    }
+    if (verbosity > 5) {cout_line() << "Responding with: " << s << endl;}
+    socket_send("DATA response", s);
+  } catch (const nlohmann::detail::exception &) {
+    respond_with_error("Unable to process DATA message jobs.");
+  }
+}
+
+string HostApp::to_resp_bytes(long resp_size, int &resp_bytes) {
+  resp_bytes = Kernel::RESP_UNBOUNDED;
+  if (resp_size == DataMsgJson::ABSENT) {
+    #ifdef KERNEL_AVAIL
+    if (!kernel.supports_unbounded()) {
+      return "This kernel requires \"resp_size\".";
+    }
+    #endif
+    return "";
+  }
+  if (resp_size < 0 || resp_size > INT_MAX / DATA_WIDTH_BYTES) {
+    return "\"resp_size\" must be an integer from 0 to " + to_string(INT_MAX / DATA_WIDTH_BYTES) + ".";
+  }
+  resp_bytes = (int)(resp_size * DATA_WIDTH_BYTES);
+  return "";
+}
+
+void HostApp::respond_with_error(const string &error, bool stream) {
+  cerr_line() << error << endl;
+  json response = json::object();
+  response["error"] = error;
+  socket_send("DATA response", response.dump());
+  if (stream) {
+    socket_send("STREAM_DATA end", string(""));
+  }
+}
+
+void HostApp::handle_upload_data_msg() {
+  json data_json = socket_recv_json("UPLOAD");
+  wait_for_kernel();
+  #ifdef OPENCL
+  HW_Kernel &kernel = next_device();
+  #endif
+  long size = DataMsgJson::field(data_json, "size");
+  if (size < 0 || size > INT_MAX / DATA_WIDTH_BYTES) {
+    // Without a valid size, the input that follows cannot be delimited, so the connection cannot be kept in sync.
+    // It is closed (and the next is accepted). (A local channel's input is simply discarded with it.)
+    if (local) {
+      respond_with_error("UPLOAD_DATA_MSG requires a valid \"size\".");
+    } else {
+      cerr_line() << "UPLOAD_DATA_MSG requires a valid \"size\". Closing the connection." << endl;
+      close(socket);
+      socket = -1;
+      socket_session = "";
+    }
+    return;
+  }
+  int resp_bytes;
+  string error = to_resp_bytes(DataMsgJson::field(data_json, "resp_size"), resp_bytes);
+  bool with_perf = false;
+  try {
+    with_perf = data_json.count("perf") && (bool)data_json["perf"];
+  } catch (const nlohmann::detail::exception &) {
+    error = "Unable to process UPLOAD_DATA_MSG.";
+  }
+  if (!error.empty()) {
+    SocketInputSource(this, size).drain();  // Receive (and discard) the input, keeping the socket in sync.
+    respond_with_error(error);
+    return;
+  }
+  DataMsgCollector collector;
+  {
+    SocketInputSource source(this, size);
+    #ifdef KERNEL_AVAIL
+    kernel.stream_kernel(source, size * DATA_WIDTH_BYTES, resp_bytes, collector, DEFAULT_STREAM_BATCH);
+    #else
+    fakeKernelStream(source, size * DATA_WIDTH_BYTES, resp_bytes, collector, DEFAULT_STREAM_BATCH);
+    #endif
+    // Once the input has been received in full.
+    if (!source.drain()) {
+      respond_with_error("UPLOAD_DATA_MSG data must be whole words, totaling the given size.");
+      return;
+    }
+  }
+  cout_line() << "Kernel produced " << collector.data_words << " words from " << size << " streamed input words." << endl;
+
+  string s = data_to_json(collector.data, collector.data_words);
+  if (with_perf) {
+    json perf = json::object();
+    #ifdef KERNEL_AVAIL
+    kernel.add_perf(perf);
+    #endif
+    s = "{\"data\": " + s + ", \"perf\": " + perf.dump() + "}";
+  }
+  if (verbosity > 5) {cout_line() << "Responding with: " << s << endl;}
+  socket_send("DATA response", s);
 }
 
 void HostApp::perror(const char * error) {
@@ -330,7 +1132,9 @@ void HostApp::socket_send(const char * tag, const void *buf, uint32_t len, bool
     uint32_t len_data = htonl(len);
     socket_send(NULL, &len_data, 4, false);
   }
-  if (send(socket, buf, len, MSG_NOSIGNAL) != (int)len) {
+  if (local) {
+    local->send((const char *)buf, len);
+  } else if (send(socket, buf, len, MSG_NOSIGNAL) != (int)len) {
     cerr_line() << "Socket send error for \"" << tag << "\"." << endl;
     exit(1);
   }
@@ -349,8 +1153,22 @@ void HostApp::socket_send(const char * tag, json j) {
 
 void HostApp::socket_recv(const char * tag, void *buf, size_t len) {
   if (verbosity > 5) {cout_line() << "Receiving " << len << "-byte \"" << tag << "\" from socket." << endl;}
-  if (recv(socket, buf, len, 0) != (int)len) {
-    cerr << "C++ Host socket receive error for \"" << tag << "\"." << endl;
+  if (local) {
+    if (!local->recv((char *)buf, len)) {
+      cerr_line() << "Local receive error for \"" << tag << "\"." << endl;
+      exit(1);
+    }
+    return;
+  }
+  // A message may arrive in any number of pieces.
+  for (size_t received = 0; received < len; ) {
+    ssize_t bytes = recv(socket, (char *)buf + received, len - received, 0);
+    if (bytes <= 0) {
+      if (bytes < 0 && errno == EINTR) {continue;}
+      cerr_line() << "Socket receive error for \"" << tag << "\"." << endl;
+      exit(1);
+    }
+    received += bytes;
   }
   if (verbosity > 7) {cout_line() << "Received " << len << "-byte \"" << tag << "\" from socket." << endl;}
 }
@@ -379,6 +1197,56 @@ string HostApp::socket_recv_string(const char * tag) {
   return str;
 }
 
+void HostApp::LocalChannel::add_input(const string &s) {
+  uint32_t len = htonl(s.length());
+  input.append((const char *)&len, 4);
+  input.append(s);
+}
+
+bool HostApp::LocalChannel::recv(char * buf, size_t len) {
+  if (input.length() - input_pos < len) {
+    return false;
+  }
+  memcpy(buf, input.data() + input_pos, len);
+  input_pos += len;
+  return true;
+}
+
+void HostApp::LocalChannel::send(const char * data, size_t len) {
+  while (len > 0) {
+    if (size_cnt < 4) {
+      // Size.
+      size_bytes[size_cnt++] = *data++;
+      len--;
+      if (size_cnt == 4) {
+        memcpy(&message_len, size_bytes, 4);
+        message_len = ntohl(message_len);
+        if (message_len == 0) {
+          message("", 0);
+          size_cnt = 0;
+        }
+      }
+    } else {
+      // Message, delivered in place if it was sent whole.
+      size_t bytes = min(len, (size_t)message_len - partial.length());
+      if (partial.empty() && bytes == message_len) {
+        message(data, message_len);
+      } else {
+        partial.append(data, bytes);
+        if (partial.length() == message_len) {
+          message(partial.data(), message_len);
+          partial.clear();
+        }
+      }
+      if (partial.empty()) {
+        size_cnt = 0;
+      }
+      data += bytes;
+      len -= bytes;
+    }
+  }
+}
+
 json HostApp::socket_recv_json(const char * tag) {
   char * c_str = socket_recv_c_string(tag);
   json ret = json::parse(c_str);
@@ -411,7 +1279,7 @@ void HostApp::init_platform(char * response) {
 
 // A wrapper around init_kernel that reports errors.
 // Use NULL response to report errors.
-void HostApp::init_kernel(char * response, const char *xclbin, const char *kernel_name, int memory_size) {
+void HostApp::init_kernel(char * response, const char *xclbin, const char *kernel_name, size_t max_buffer_bytes) {
   char rsp[MSG_LENGTH];
   if (response == NULL) {
     response = rsp;
@@ -420,7 +1288,7 @@ void HostApp::init_kernel(char * response, const char *xclbin, const char *kerne
     sprintf(response, "Error: first initialize platform");
   } else {
     if(!kernel.initialized) {
-      kernel.initialize_kernel(xclbin, kernel_name, memory_size);
+      kernel.initialize_kernel(xclbin, kernel_name, max_buffer_bytes);
       if (kernel.status)
         sprintf(response, "Error: Could not initialize the kernel");
       else {
@@ -515,19 +1383,35 @@ int HostApp::handle_read_data(const void * data, int data_size) {
 ** socket: reference to the socket channel with the web server
 ** cl: OpenCL datatypes
 */
-void HostApp::handle_get_image(int ** data_array_p, input_struct * input_p) {
+bool HostApp::handle_get_image(int ** data_array_p, input_struct * inputs, int cnt) {
+  wait_for_kernel();
   if (verbosity > 3) {
-    cout << "handle_get_image(..) input_struct: [" <<
-          input_p->coordinates[0] << ", " <<
-          input_p->coordinates[1] << ", " <<
-          input_p->coordinates[2] << ", " <<
-          input_p->coordinates[3] << ", " <<
-          input_p->width << ", " <<
-          input_p->height << ", " <<
-          input_p->max_depth << "]" <<
-          endl;
-  }
-  kernel.write_kernel_data(input_p, DATA_WIDTH_BYTES);  // sizeof(input_struct));  TODO: I used full data width, but the structure is smaller.
+    for (int i = 0; i < cnt; i++) {
+      cout << "handle_get_image(..) input_struct: " << DescriptorWord::to_json(DescriptorWord::read(&inputs[i])).dump() << endl;
+    }
+  }
+  #ifdef OPENCL
+  // Split a large image into row strips, and spread descriptors over devices, or send the request to the next device.
+  if (num_devices() > 1) {
+    vector<input_struct> descriptors(inputs, inputs + cnt);
+    int strip_rows = (inputs[0].height + num_devices() - 1) / num_devices();
+    if (cnt == 1 && strip_rows >= MIN_STRIP_ROWS) {
+      descriptors.clear();
+      for (int row = 0; row < inputs[0].height; row += strip_rows) {
+        input_struct strip = inputs[0];
+        strip.coordinates[1] = inputs[0].coordinates[1] + row * inputs[0].coordinates[3];
+        strip.height = (inputs[0].height - row < strip_rows) ? inputs[0].height - row : strip_rows;
+        descriptors.push_back(strip);
+      }
+    }
+    if (descriptors.size() > 1) {
+      return get_image_strips(data_array_p, descriptors);
+    }
+  }
+  HW_Kernel &kernel = next_device();
+  #endif
+  // All descriptors go in one launch.
+  kernel.write_kernel_data(inputs, cnt * DATA_WIDTH_BYTES);
   if (verbosity > 2) {cout << "Wrote kernel." << endl;}
 
   // check timing
@@ -540,11 +1424,23 @@ void HostApp::handle_get_image(int ** data_array_p, input_struct * input_p) {
   kernel.start_kernel();
   if (verbosity > 2) {cout << "Started kernel." << endl;}
 
-  int data_bytes = input_p->width * input_p->height * (int)sizeof(int);
-  *data_array_p = (int *) malloc(data_bytes);
+  int data_bytes = (int)input_struct_pixels(inputs, cnt * DATA_WIDTH_BYTES) * (int)sizeof(int);
 
   if (verbosity > 2) {cout << "Reading kernel data (" << data_bytes << " bytes)." << endl;}
-  kernel.read_kernel_data(*data_array_p, data_bytes);
+  #ifdef OPENCL
+  // Hand out the kernel's output buffer in place (released by release_image).
+  *data_array_p = kernel.map_output(data_bytes);
+  #else
+  *data_array_p = (int *) BufferPool::shared().alloc(data_bytes);
+  if (kernel.read_kernel_data(*data_array_p, data_bytes) != data_bytes) {
+    BufferPool::shared().release(*data_array_p);
+    *data_array_p = NULL;
+  }
+  #endif
+  if (*data_array_p == NULL) {
+    cerr_line() << "GET_IMAGE failed in the kernel (" << data_bytes << " bytes of images)." << endl;
+    return false;
+  }
   if (verbosity > 3) {cout << "Read kernel data (" << data_bytes << " bytes)." << endl;}
 
   if (verbosity > 2) {
@@ -552,8 +1448,62 @@ void HostApp::handle_get_image(int ** data_array_p, input_struct * input_p) {
     clock_gettime(CLOCK_MONOTONIC_RAW, &end);
     delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
 
-    cout_line() << "Kernel execution time GET_IMAGE: " << delta_us << " us." << endl;
+    cout_line() << "Kernel execution time GET_IMAGE (" << cnt << " image(s)): " << delta_us << " us." << endl;
+  }
+  return true;
+}
+
+#ifdef OPENCL
+bool HostApp::get_image_strips(int ** data_array_p, vector<input_struct> &descriptors) {
+  // Each device gets a contiguous group of descriptors, in one launch.
+  int groups = ((int)descriptors.size() < num_devices()) ? (int)descriptors.size() : num_devices();
+  vector<int> first(groups + 1);
+  for (int d = 0; d <= groups; d++) {
+    first[d] = d * (int)descriptors.size() / groups;
+  }
+  // (Uploads are non-blocking, so descriptors must persist until responses are read.)
+  for (int d = 0; d < groups; d++) {
+    device(d).write_kernel_data(&descriptors[first[d]], (first[d + 1] - first[d]) * DATA_WIDTH_BYTES);
+    device(d).start_kernel();
+  }
+  // Gather the groups' images, which are consecutive in the output.
+  int data_bytes = (int)input_struct_pixels(descriptors.data(), (int)descriptors.size() * DATA_WIDTH_BYTES) * (int)sizeof(int);
+  *data_array_p = (int *) BufferPool::shared().alloc(data_bytes);
+  int * group_data = *data_array_p;
+  bool ok = true;
+  for (int d = 0; d < groups; d++) {
+    int group_bytes = (int)input_struct_pixels(&descriptors[first[d]], (first[d + 1] - first[d]) * DATA_WIDTH_BYTES) * (int)sizeof(int);
+    // (Each device's job is read, even after a failure, so none is left in flight.)
+    ok = device(d).read_kernel_data(group_data, group_bytes) == group_bytes && ok;
+    group_data += group_bytes / sizeof(int);
+  }
+  if (!ok) {
+    cerr_line() << "GET_IMAGE failed in the kernel of at least one device (" << data_bytes << " bytes of images)." << endl;
+    BufferPool::shared().release(*data_array_p);
+    *data_array_p = NULL;
+    return false;
+  }
+  if (verbosity > 2) {cout_line() << "GET_IMAGE computed " << descriptors.size() << " descriptors on " << groups << " devices." << endl;}
+  return true;
+}
+
+HW_Kernel &HostApp::next_device() {
+  HW_Kernel &ret = device(next_device_index);
+  next_device_index = (next_device_index + 1) % num_devices();
+  return ret;
+}
+#endif
+
+void HostApp::release_image(int * data_array) {
+  #ifdef OPENCL
+  for (int d = 0; d < num_devices(); d++) {
+    if (device(d).is_mapped_output(data_array)) {
+      device(d).unmap_output(data_array);
+      return;
+    }
   }
+  #endif
+  BufferPool::shared().release(data_array);
 }
 #endif
 
@@ -574,14 +1524,31 @@ int HostApp::get_command(const char * command) {
     return READ_DATA_N;
   else if(!strncmp(command, CLEAN_KERNEL, strlen(CLEAN_KERNEL)))
     return CLEAN_KERNEL_N;
+  // (GET_IMAGE is a prefix of GET_IMAGES.)
+  else if(!strncmp(command, GET_IMAGES, strlen(GET_IMAGES)))
+    return GET_IMAGES_N;
   else if(!strncmp(command, GET_IMAGE, strlen(GET_IMAGE)))
     return GET_IMAGE_N;
   else if(!strncmp(command, DATA_MSG, strlen(DATA_MSG)))
     return DATA_MSG_N;
+  else if(!strncmp(command, STREAM_DATA_MSG, strlen(STREAM_DATA_MSG)))
+    return STREAM_DATA_MSG_N;
   else if(!strncmp(command, START_TRACING, strlen(START_TRACING)))
     return START_TRACING_N;
   else if(!strncmp(command, STOP_TRACING, strlen(STOP_TRACING)))
     return STOP_TRACING_N;
+  else if(!strncmp(command, SELECT_SESSION, strlen(SELECT_SESSION)))
+    return SELECT_SESSION_N;
+  else if(!strncmp(command, END_SESSION, strlen(END_SESSION)))
+    return END_SESSION_N;
+  else if(!strncmp(command, STATS, strlen(STATS)))
+    return STATS_N;
+  else if(!strncmp(command, SAVE_CHECKPOINT, strlen(SAVE_CHECKPOINT)))
+    return SAVE_CHECKPOINT_N;
+  else if(!strncmp(command, LOAD_MEMORY, strlen(LOAD_MEMORY)))
+    return LOAD_MEMORY_N;
+  else if(!strncmp(command, UPLOAD_DATA_MSG, strlen(UPLOAD_DATA_MSG)))
+    return UPLOAD_DATA_MSG_N;
   else
     return -1;
 }
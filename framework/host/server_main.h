@@ -48,14 +48,23 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include <time.h>
+#include <errno.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
-#ifdef KERNEL_AVAIL
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "kernel.h"
+#ifdef KERNEL_AVAIL
 #ifndef OPENCL
 #include "sim_kernel.h"
 #endif
@@ -65,9 +74,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "kernel.h"
 #include "hw_kernel.h"
 #endif
+#ifdef SW_MODEL
+#include "sw_kernel.h"
+#endif
 
 #include "lodepng.h"
 #include "protocol.h"
+#include "buffer_pool.h"
+#include "data_msg_json.h"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -97,6 +111,8 @@ using json = nlohmann::json;
 
 using namespace std;
 
+class HttpFrontEnd;
+
 class HostApp {
 
 public:
@@ -104,13 +120,52 @@ public:
   ostream & cerr_line() {return(cerr << "C++ Error: ");}
 
   // The default body of the main function for the server.
-  // argv if OPENCL:
-  //   [-s socket-name] [xclbin-name-if-OPENCL]
+  // argv:
+  //   [-s socket-name] [-p [http-address:]http-port] [-m sw-model-library-if-SW_MODEL] [-w trace-window-cycles-if-sim] [-c checkpoint-file-if-sim] [-H] [-v platform-vendor-if-OPENCL] [-M max-device-buffer-MB-if-OPENCL] [-d max-devices-if-OPENCL] [xclbin-name-if-OPENCL]
+  // For SW_MODEL, the model library defaults to <kernel_name>_model.so alongside the executable, if it exists.
+  // -H backs large I/O buffers with huge pages (see buffer_pool.h).
+  // -p serves image and WebSocket requests directly over HTTP on the given port (see http_front_end.h), in addition to
+  //    the web server's requests over the socket. Only local clients are served unless an address is given, e.g.
+  //    -p 0.0.0.0:8888 for all interfaces.
+  // -v selects the OpenCL platform by vendor (default "Xilinx"), e.g. to stand in a CPU OpenCL platform.
+  // -M caps the size of each device buffer (default 256MB). Buffers are sized to requests up to this cap.
+  // -d limits the number of devices used (default: all matching devices).
+  // -c restores the kernel context from the given checkpoint file at startup, if it exists, for a warm start. The
+  //    SAVE_CHECKPOINT command saves to this file.
+  // -w sets the number of cycles of rolling trace window kept when tracing the simulation (default 100000, 0 for all).
   int server_main(int argc, char const *argv[], const char *kernel_name);
 
   // Main method for processing traffic from/to the client.
   void processTraffic();
 
+  /*
+  ** A channel used in place of the socket to process a command locally (see process_local(..)). The command's input is
+  ** received from the sized messages given to add_input(..), and each sized message of its response is delivered to
+  ** message(..).
+  */
+  class LocalChannel {
+  public:
+    virtual ~LocalChannel() {}
+    void add_input(const string &s);
+    // As for the socket. recv(..) returns false if the input is exhausted.
+    bool recv(char * buf, size_t len);
+    void send(const char * data, size_t len);
+  protected:
+    virtual void message(const char * data, uint32_t len) = 0;
+  private:
+    string input;
+    size_t input_pos = 0;
+    char size_bytes[4];  // The size of the response message being sent, as it is sent.
+    int size_cnt = 0;
+    uint32_t message_len = 0;
+    string partial;  // The response message being sent, if it is sent in pieces.
+  };
+  /*
+  ** Process a command locally, using channel in place of the socket, in the kernel context of the given session
+  ** (if non-NULL). The web server's session is restored for its next command.
+  */
+  void process_local(const char * command, LocalChannel &channel, const char * session = NULL);
+
   /*
   ** Data structure to handle a array of doubles and its size to have a dynamic behaviour
   ** TODO: This is messy. At least make it an object with destructor.
@@ -122,20 +177,113 @@ public:
 
 #ifdef KERNEL_AVAIL
 #ifdef OPENCL
-  HW_Kernel kernel;
+  HW_Kernel kernel;  // The first device.
+  vector<HW_Kernel *> other_devices;  // Any other devices, each with its own context, queue, and buffers.
+  HW_Kernel &device(int d) {return d ? *other_devices[d - 1] : kernel;}
+  int num_devices() {return 1 + (int)other_devices.size();}
 #else
   SIM_Kernel kernel;
 #endif
+#endif
+#ifdef SW_MODEL
+  // A software model of the kernel, used by fakeKernel(..) if loaded.
+  SW_Kernel sw_kernel;
 #endif
 
   static const int DATA_WIDTH_BYTES = 64;
   static const int DATA_WIDTH_WORDS = DATA_WIDTH_BYTES / 4; //
   static const int DATA_WIDTH_BITS = DATA_WIDTH_BYTES * 8;  // 512 bits
   static const int verbosity = 0; // 0: no debug messages; 10: all debug messages.
+  static const int DEFAULT_STREAM_BATCH = 64;  // Default number of 512-bit words per STREAM_DATA_MSG response.
+  static const int MIN_STRIP_ROWS = 16;  // With multiple devices, images are split into strips of at least this many rows.
+  static const int UPLOAD_BUFFERS = 4;  // UPLOAD_DATA_MSG input is received ahead of the kernel into this many buffers
+  static const int UPLOAD_BUFFER_BYTES = 1 << 20;  // of this size.
+
+  /*
+  ** A KernelOutputSink that sends each batch of kernel output over the socket as a DATA_MSG-style response.
+  */
+  class DataMsgSender : public KernelOutputSink {
+  public:
+    DataMsgSender(HostApp * app) : app(app) {}
+    void consume(const uint32_t * data, int data_words);
+  private:
+    HostApp * app;
+  };
+
+  /*
+  ** A KernelOutputSink that accumulates kernel output, growing its buffer as needed, for responses of unknown size.
+  */
+  class DataMsgCollector : public KernelOutputSink {
+  public:
+    uint32_t * data = NULL;
+    int data_words = 0;
+    ~DataMsgCollector() {BufferPool::shared().release(data);}
+    void consume(const uint32_t * data, int data_words);
+  private:
+    int capacity_words = 0;
+  };
+
+  /*
+  ** A KernelInputSource receiving the input of an UPLOAD_DATA_MSG from the socket, as messages (each prefixed with its
+  ** size) of whole 512-bit words. A thread receives ahead of the kernel, into a bounded ring of buffers.
+  */
+  class SocketInputSource : public KernelInputSource {
+  public:
+    SocketInputSource(HostApp * app, size_t data_words);
+    // Receives (and discards) any input the kernel did not consume, so the socket remains in sync.
+    ~SocketInputSource();
+    // Produces NULL once the input is received in full, or, early, if it is malformed.
+    const uint32_t * produce(int &data_words);
+    // As the destructor, returning false if the input was malformed.
+    bool drain();
+  private:
+    HostApp * app;
+    size_t data_bytes;
+    uint32_t * buffers[UPLOAD_BUFFERS];
+    int buffer_words[UPLOAD_BUFFERS];
+    // Buffers are filled and consumed in order. Counts of buffers filled, produced, and done (consumed).
+    int filled = 0;
+    int produced = 0;
+    int done = 0;
+    bool received = false;  // All input has been received.
+    bool abandoned = false;  // No more input will be consumed.
+    bool failed = false;  // The input was malformed, so it ends early (and the rest is discarded).
+    mutex m;
+    condition_variable cv;
+    thread receiver;
+    void receive();
+  };
 
 protected:
   string socket_filename = "SOCKET"; // The name of the socket file.
-  int socket;  // The ID of the socket connected to the web server.
+  string checkpoint_filename;  // The kernel checkpoint file restored at startup and saved by SAVE_CHECKPOINT (if any).
+  int socket = -1;  // The ID of the socket connected to the web server.
+  LocalChannel * local = NULL;  // The channel used in place of the socket, while processing a command locally.
+  string socket_session;  // The session last selected by the web server.
+  bool socket_session_stale = false;  // A local command may have selected a different session.
+  HttpFrontEnd * http_front_end = NULL;
+  map<string, LatencyHistogram> command_latency;  // Processing time of each command (for STATS).
+  struct timespec start_time;  // When server_main(..) was entered.
+  json startup_ms = json::object();  // Time from start_time to the completion of each phase of startup (for STATS).
+#ifdef OPENCL
+  thread kernel_init_thread;  // Initializes the kernel at startup.
+  atomic<bool> kernel_initialized{false};
+  double kernel_ready_ms = 0.0;
+#endif
+
+  double ms_since_start();
+  /*
+  ** For OpenCL, the kernel is initialized on a background thread at startup, while requests are accepted.
+  ** kernel_ready() reports whether it has completed (so a request can be served otherwise, e.g. by rendering in C++),
+  ** and wait_for_kernel() waits for it. Requests that use the kernel must wait (and are thereby queued).
+  */
+  bool kernel_ready();
+  void wait_for_kernel();
+
+  /*
+  ** Process the given command, whose arguments follow on the socket (or local channel).
+  */
+  void process_command(const string &msg);
 
   /*
   ** This function is needed to translate the message coming from
@@ -198,18 +346,78 @@ protected:
   */
   json socket_recv_json(const char * tag);
 
+  /*
+  ** Process a DATA_MSG (or a STREAM_DATA_MSG, if stream).
+  */
+  void handle_data_msg(bool stream);
+  /*
+  ** Process a DATA_MSG of "jobs", running them back to back, and respond with an array of their responses.
+  ** On hardware, up to HW_BUFFER_SETS jobs are in flight, so each job's input is transferred while the previous runs.
+  */
+  void handle_data_jobs(json &data_json);
+  /*
+  ** Process an UPLOAD_DATA_MSG, streaming its input to the kernel as it is received.
+  */
+  void handle_upload_data_msg();
+  /*
+  ** Set resp_bytes to the response capacity for a "resp_size" field (see DataMsgJson::field(..)), or to
+  ** Kernel::RESP_UNBOUNDED if it is absent. Returns an error message, or "" if the field is valid (and, if absent, the
+  ** kernel can deliver an unbounded response).
+  */
+  string to_resp_bytes(long resp_size, int &resp_bytes);
+  /*
+  ** Respond to a DATA_MSG (or STREAM_DATA_MSG, if stream) that cannot be processed with {"error": error} (followed by
+  ** the terminating empty response, if stream). The request must have been received in full.
+  */
+  void respond_with_error(const string &error, bool stream = false);
+  /*
+  ** Respond to STATS with a JSON object of host statistics: latency histograms per command, buffer pool usage, and
+  ** anything reported by the kernel(s).
+  */
+  void handle_stats();
+  /*
+  ** Process a LOAD_MEMORY, writing kernel memory directly, and respond with the number of entries written or an error.
+  */
+  void handle_load_memory();
+  /*
+  ** Convert data to a JSON array of 16-element arrays of unsigned integers.
+  **  - data: the data
+  **  - data_words: the number of 512-bit words of data
+  */
+  string data_to_json(const uint32_t * data, int data_words);
+  /*
+  ** Populate data from a JSON array of data_words 16-element arrays of unsigned integers.
+  ** Throws a JSON exception if data_json is not of this form.
+  */
+  void json_to_data(const json &data_json, size_t data_words, uint32_t * data);
+
   /*
   ** Utility function to handle the command decode coming from the socket
   ** connection with the python web server
   */
   #ifdef KERNEL_AVAIL
   void init_platform(char * response);
-  void init_kernel(char * response, const char *xclbin, const char *kernel_name, int memory_size);
+  void init_kernel(char * response, const char *xclbin, const char *kernel_name, size_t max_buffer_bytes);
   #else
   char *image_buffer;
   #endif
 
-  virtual void fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer);
+  /*
+  ** Kernel behavior without a kernel. By default, this uses the software model, if one is loaded (SW_MODEL),
+  ** or echoes the input. bytes_out is the capacity of out_buffer. Returns the number of bytes of response produced.
+  */
+  virtual size_t fakeKernel(size_t bytes_in, void * in_buffer, size_t bytes_out, void * out_buffer);
+  /*
+  ** Kernel behavior without a kernel, for streamed or unbounded (bytes_out == Kernel::RESP_UNBOUNDED) responses.
+  ** By default, this streams through the software model, if one is loaded, or delivers the result of fakeKernel(..)
+  ** to sink in batches.
+  */
+  virtual void fakeKernelStream(size_t bytes_in, void * in_buffer, int bytes_out, KernelOutputSink &sink, int batch_words);
+  /*
+  ** As above, for input from source. This streams the input into the software model, if one is loaded, or gathers it
+  ** for the above.
+  */
+  void fakeKernelStream(KernelInputSource &source, size_t bytes_in, int bytes_out, KernelOutputSink &sink, int batch_words);
 
   /*
   ** Utility function to handle the data coming from the socket and sent to the FPGA device
@@ -222,10 +430,31 @@ protected:
   int handle_read_data(const void * data, int data_size);
 
   #ifdef KERNEL_AVAIL
-  void handle_get_image(int ** data_array_p, input_struct * input_p);
+  /*
+  ** Compute the images of cnt descriptors in the kernel, in a single launch. *data_array_p holds the images
+  ** consecutively, and must be released by release_image. For OpenCL, it is the kernel's mapped output buffer, so the
+  ** images are consumed in place, without a copy, unless the work is split across devices.
+  ** Returns false (with *data_array_p NULL) if the kernel failed to compute them (e.g. for a request exceeding the
+  ** device buffer cap), so they can be rendered otherwise.
+  */
+  bool handle_get_image(int ** data_array_p, input_struct * inputs, int cnt = 1);
+  void release_image(int * data_array);
+  #ifdef OPENCL
+  /*
+  ** For handle_get_image, compute the images of the given descriptors (tiles, or strips of one image), spreading them
+  ** over devices in contiguous groups, which run concurrently. Returns false, as handle_get_image, if any group fails.
+  */
+  bool get_image_strips(int ** data_array_p, vector<input_struct> &descriptors);
+  /*
+  ** The device to use for the next request (round-robin).
+  */
+  HW_Kernel &next_device();
+  int next_device_index = 0;
+  #endif
   #endif
 
   virtual void get_image() {printf("No defined behavior for get_image()\n");}
+  virtual void get_images() {printf("No defined behavior for get_images()\n");}
 
 };
 
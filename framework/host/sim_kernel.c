@@ -48,27 +48,121 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <fstream>
+#include <algorithm>
 #include "kernel.h"
 #include "sim_kernel.h"
-#include "verilated_vcd_c.h"
+#include "buffer_pool.h"
+#include "svdpi.h"
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+#endif
 
 
-const int SIM_Kernel::MAX_PHASES = 100000000;
-const int SIM_Kernel::MAX_TRACE_PHASES = 1000;
+const uint64_t SIM_Kernel::MAX_PHASES = 100000000;
+const uint64_t SIM_Kernel::DEFAULT_TRACE_WINDOW_CYCLES = 100000;
+const int SIM_Kernel::STREAM_FLUSH_MS = 100;
+const size_t SIM_Kernel::MAX_REPLAY_BYTES = (size_t)64 << 20;
+static const char CHECKPOINT_MAGIC[] = "SIM_Kernel checkpoint v2\n";
+
+// Kernels may optionally provide an out_last output, asserted with the last word of a response. This reports
+// out_last, or false for kernels without it.
+template <typename K>
+static auto kernel_out_last(K * k, int) -> decltype(k->out_last, bool()) {
+  return k->out_last;
+}
+template <typename K>
+static bool kernel_out_last(K * k, long) {
+  return false;
+}
+// Kernels may optionally provide a quiescent output, asserted while the kernel is idle: holding no work in flight and
+// producing no output until it accepts more input. This reports quiescent, or false for kernels without it.
+template <typename K>
+static auto kernel_quiescent(K * k, int) -> decltype(k->quiescent, bool()) {
+  return k->quiescent;
+}
+template <typename K>
+static bool kernel_quiescent(K * k, long) {
+  return false;
+}
+
+#ifdef SIM_SAVABLE
+// Verilator save/restore streams to/from memory, for kernel contexts.
+class VerilatedSaveMem : public VerilatedSerialize {
+public:
+  VerilatedSaveMem(std::string &data) : data(data) {
+    data.clear();
+    m_isOpen = true;
+    header();
+  }
+  ~VerilatedSaveMem() {close();}
+  void close() {
+    if (isOpen()) {
+      trailer();
+      flush();
+      m_isOpen = false;
+    }
+  }
+  void flush() {
+    data.append((const char *)m_bufp, m_cp - m_bufp);
+    m_cp = m_bufp;
+  }
+private:
+  std::string &data;
+};
+
+class VerilatedRestoreMem : public VerilatedDeserialize {
+public:
+  VerilatedRestoreMem(const std::string &data) : data(data) {
+    m_endp = m_bufp;
+    m_isOpen = true;
+    header();
+  }
+  ~VerilatedRestoreMem() {close();}
+  void close() {
+    if (isOpen()) {
+      trailer();
+      m_isOpen = false;
+    }
+  }
+  void fill() {
+    // Move unread bytes to the start of the buffer, and append what fits from data.
+    size_t unread = m_endp - m_cp;
+    memmove(m_bufp, m_cp, unread);
+    m_cp = m_bufp;
+    m_endp = m_bufp + unread;
+    size_t cnt = data.size() - pos;
+    if (cnt > bufferSize() - unread) {cnt = bufferSize() - unread;}
+    memcpy(m_endp, data.data() + pos, cnt);
+    m_endp += cnt;
+    pos += cnt;
+  }
+private:
+  const std::string &data;
+  size_t pos = 0;
+};
+#endif
+
+// Discards output, for replaying inputs.
+class DiscardSink : public KernelOutputSink {
+public:
+  void consume(const uint32_t * data, int data_words) {}
+};
 
 SIM_Kernel::SIM_Kernel() {
   this->verilator_kernel = new VERILATOR_KERNEL;
-  Verilated::traceEverOn(true);
-  this->tfp = new VerilatedVcdC;
-
+  this->tfp = new SimTraceFile;
+  cout << "Simulating with " << SIM_THREADS << " thread(s)." << endl;
 }
 
 SIM_Kernel::~SIM_Kernel() {
   tfp->close();
   delete tfp;
+  delete traced_kernel;
   delete verilator_kernel;
 }
 
@@ -78,67 +172,491 @@ void SIM_Kernel::perror(const char * msg) {
 }
 
 void SIM_Kernel::enable_tracing() {
-  verilator_kernel->trace (tfp, 99);
-  tfp->open ("../out/sim/trace.vcd");
+  use_traced_model(true);
+  unlink(TRACE_PREV_FILE);
+  tfp->open (TRACE_FILE);
   tracing_enabled = true;
   trace_phase_cnt = 0;
+  traced_phase_cnt = 0;
+}
+
+void SIM_Kernel::rotate_trace() {
+  tfp->close();
+  rename(TRACE_FILE, TRACE_PREV_FILE);
+  tfp->open (TRACE_FILE);  // (The new file begins with a full dump of values.)
+  trace_phase_cnt = 0;
 }
 
 void SIM_Kernel::disable_tracing() {
   tracing_enabled = false;
+  use_traced_model(false);
+}
+
+void SIM_Kernel::use_traced_model(bool traced) {
+  if (traced == traced_active) {
+    return;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (traced) {
+    if (!traced_kernel) {
+      Verilated::traceEverOn(true);
+      // (Named distinctly, so the models' public signals have distinct scopes.)
+      traced_kernel = new VERILATOR_KERNEL_TRACED("TRACED");
+      traced_kernel->trace (tfp, 99);
+    }
+    #ifdef SIM_SAVABLE
+    // The untraced model's context is preserved for the switch back.
+    save_context(saved_contexts[cur_session]);
+    #endif
+    traced_active = true;
+    load_context(cur_session);
+  } else {
+    traced_active = false;
+    // Contexts that ran in the traced model are reconstructed from their inputs.
+    #ifdef SIM_SAVABLE
+    for (std::set<std::string>::iterator it = traced_sessions.begin(); it != traced_sessions.end(); it++) {
+      saved_contexts.erase(*it);
+    }
+    load_context(cur_session);
+    #else
+    if (traced_sessions.count(cur_session)) {
+      load_context(cur_session);
+    }
+    #endif
+    traced_sessions.clear();
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  cout << "Switched to the " << (traced ? "traced" : "untraced") << " model in " << delta_us << " us." << endl;
+}
+
+void SIM_Kernel::load_context(const std::string &session) {
+  ReplayLog &log = replay_logs[session];
+  bool from_base = log.from_base;
+  bool base_ok = true;
+  if (traced_active) {
+    reset_model(traced_kernel);
+    if (log.from_base) {
+      base_ok = replay(base_log);
+    }
+  } else {
+    #ifdef SIM_SAVABLE
+    std::map<std::string, std::string>::iterator it = saved_contexts.find(session);
+    if (it != saved_contexts.end()) {
+      restore_context(it->second);
+      saved_contexts.erase(it);  // Held by the model, now.
+      return;
+    }
+    restore_context((log.from_base && !base_context.empty()) ? base_context : reset_context);
+    #else
+    reset_model(verilator_kernel);
+    #endif
+  }
+  if (!base_ok || !replay(log)) {
+    cout << "Warning: Inputs to the kernel context for session \"" << session << "\" exceeded " << MAX_REPLAY_BYTES << " bytes and cannot be replayed. Context is reset." << endl;
+    log = ReplayLog();
+    log.from_base = from_base && base_ok;
+  }
+}
+
+bool SIM_Kernel::replay(const ReplayLog &log) {
+  if (log.truncated) {
+    return false;
+  }
+  // Rerun the logged transactions, discarding responses (and not tracing them).
+  bool orig_tracing_enabled = tracing_enabled;
+  tracing_enabled = false;
+  void * orig_input_buff = input_buff;
+  unsigned int orig_data_size = data_size;
+  int orig_resp_data_size = resp_data_size;
+  const unsigned int batch_words = 64;
+  uint32_t * buff = (uint32_t *)BufferPool::shared().alloc(batch_words*HostApp::DATA_WIDTH_BYTES);
+  DiscardSink sink;
+  for (size_t i = 0; i < log.transactions.size(); i++) {
+    const Transaction &t = log.transactions[i];
+    if (!t.memory.empty()) {
+      std::string error;
+      if (!write_memory(t.memory, t.address, t.data, error)) {
+        cout << "Warning: Failed to replay a load of memory " << t.memory << ": " << error << endl;
+      }
+      continue;
+    }
+    input_buff = (void *)t.data.data();
+    data_size = t.data.size() / HostApp::DATA_WIDTH_BYTES;
+    resp_data_size = t.resp_data_size;
+    if (traced_active) {
+      run_model(traced_kernel, buff, batch_words, &sink);
+    } else {
+      run_model(verilator_kernel, buff, batch_words, &sink);
+    }
+  }
+  BufferPool::shared().release(buff);
+  input_buff = orig_input_buff;
+  data_size = orig_data_size;
+  resp_data_size = orig_resp_data_size;
+  tracing_enabled = orig_tracing_enabled;
+  return true;
 }
 
 void SIM_Kernel::save_trace() {
+  if (!tfp->isOpen()) {
+    return;
+  }
   tfp->close();
+  bool rotated = traced_phase_cnt > trace_phase_cnt;
+  cout << "Saved the last " << (trace_phase_cnt + (rotated ? trace_window_cycles * 2 : 0)) / 2 << " of " << traced_phase_cnt / 2
+       << " traced cycles to " << (rotated ? TRACE_PREV_FILE " and " : "") << TRACE_FILE << "." << endl;
 }
 
-void SIM_Kernel::tick() {
-  //verilator_kernel->reset = 0;
-  verilator_kernel->clk = !verilator_kernel->clk;
-  verilator_kernel->eval();
+template <typename M>
+void SIM_Kernel::tick(M * model) {
+  //model->reset = 0;
+  model->clk = !model->clk;
+  model->eval();
   if (tracing_enabled) {
+    if (trace_window_cycles && trace_phase_cnt >= trace_window_cycles * 2) {
+      rotate_trace();
+    }
     tfp->dump (phase_cnt);
     trace_phase_cnt++;
-    
-    // A quick-n-dirty protection against kernels that don't complete.
-    // Close the trace and exit if phase_cnt > MAX.
-    if (trace_phase_cnt > MAX_TRACE_PHASES) {
-      save_trace();
-      cout << "Traced more than " << MAX_TRACE_PHASES << " phases. Exiting." << endl;
-      exit(1);
-    }
+    traced_phase_cnt++;
   }
-  if (phase_cnt > MAX_PHASES) {
+  // A quick-n-dirty protection against kernels that don't complete.
+  // Save the trace and exit if the transaction exceeds MAX_PHASES.
+  if (phase_cnt - run_start_phase > MAX_PHASES) {
       cout << "Kernel failed to complete within " << MAX_PHASES << " phases. Exiting." << endl;
+      if (tracing_enabled) {
+        save_trace();
+      }
       exit(1);
   }
   phase_cnt++;
 }
 
-void SIM_Kernel::reset_kernel() {
-  verilator_kernel->in_avail = 0;
-  verilator_kernel->out_ready = 0;
-  verilator_kernel->reset = 1;
+template <typename M>
+void SIM_Kernel::reset_model(M * model) {
+  run_start_phase = phase_cnt;
+  model->in_avail = 0;
+  model->out_ready = 0;
+  model->reset = 1;
   //TODO: parameterize the reset duration
   for(int rst_cntr=0; rst_cntr<10; rst_cntr++) {
-    tick();
+    tick(model);
+  }
+  model->reset = 0;
+}
+
+void SIM_Kernel::reset_kernel() {
+  replay_logs[cur_session] = ReplayLog();
+  replay_logs[cur_session].from_base = false;
+  if (traced_active) {
+    reset_model(traced_kernel);
+    return;
   }
-  verilator_kernel->reset = 0;
+  reset_model(verilator_kernel);
+  #ifdef SIM_SAVABLE
+  // New sessions start from this context.
+  save_context(reset_context);
+  #endif
+}
+
+void SIM_Kernel::save_context(std::string &context) {
+  #ifdef SIM_SAVABLE
+  VerilatedSaveMem os(context);
+  os << *verilator_kernel;
+  #endif
+}
+
+void SIM_Kernel::restore_context(const std::string &context) {
+  #ifdef SIM_SAVABLE
+  VerilatedRestoreMem is(context);
+  is >> *verilator_kernel;
+  #endif
+}
+
+void SIM_Kernel::select_session(const char * session) {
+  #ifdef SIM_SAVABLE
+  if (cur_session == session) {
+    return;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Preserve the current context (unless it can be replayed in the traced model), and restore (or create) the new one.
+  size_t saved_bytes = 0;
+  if (!traced_active) {
+    std::string &saved = saved_contexts[cur_session];
+    save_context(saved);
+    saved_bytes = saved.size();
+  }
+  bool is_new = saved_contexts.find(session) == saved_contexts.end() && replay_logs.find(session) == replay_logs.end();
+  cur_session = session;
+  load_context(cur_session);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  cout << "Switched to " << (is_new ? "new " : "") << "kernel context for session " << session << " in " << delta_us << " us (" << saved_bytes << "-byte context)." << endl;
+  #endif
+}
+
+void SIM_Kernel::end_session(const char * session) {
+  #ifdef SIM_SAVABLE
+  saved_contexts.erase(session);
+  replay_logs.erase(session);
+  traced_sessions.erase(session);
+  if (cur_session == session) {
+    // Return the model to the shared default context (or a fresh one).
+    cur_session = "";
+    load_context(cur_session);
+  }
+  #endif
+}
+
+#ifdef SIM_SAVABLE
+// Checkpoint file I/O of size-prefixed strings.
+static void write_bytes(std::ostream &os, const std::string &bytes) {
+  uint64_t size = bytes.size();
+  os.write((const char *)&size, sizeof(size));
+  os.write(bytes.data(), size);
+}
+static bool read_bytes(std::istream &is, std::string &bytes, uint64_t max_size) {
+  uint64_t size = 0;
+  is.read((char *)&size, sizeof(size));
+  if (!is || size > max_size) {
+    return false;
+  }
+  bytes.resize(size);
+  is.read(&bytes[0], size);
+  return (bool)is;
+}
+#endif
+
+// A checkpoint holds the model context and the inputs that produced it (so it can also be reconstructed in the traced
+// model).
+bool SIM_Kernel::save_checkpoint(const char * filename) {
+  #ifdef SIM_SAVABLE
+  if (traced_active) {
+    cout << "Error: Cannot save a checkpoint while tracing." << endl;
+    return false;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  std::string context;
+  save_context(context);
+  const ReplayLog &log = replay_logs[cur_session];
+  bool from_base = log.from_base && !base_context.empty();
+  std::ofstream os(filename, std::ios::binary | std::ios::trunc);
+  os.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  write_bytes(os, context);
+  uint8_t truncated = log.truncated || (from_base && base_log.truncated);
+  uint64_t cnt = truncated ? 0 : (from_base ? base_log.transactions.size() : 0) + log.transactions.size();
+  os.write((const char *)&truncated, sizeof(truncated));
+  os.write((const char *)&cnt, sizeof(cnt));
+  for (int part = from_base ? 0 : 1; part < 2 && !truncated; part++) {
+    const ReplayLog &l = part ? log : base_log;
+    for (size_t i = 0; i < l.transactions.size(); i++) {
+      const Transaction &t = l.transactions[i];
+      int32_t resp_size = t.resp_data_size;
+      int64_t address = t.address;
+      os.write((const char *)&resp_size, sizeof(resp_size));
+      write_bytes(os, t.data);
+      write_bytes(os, t.memory);
+      os.write((const char *)&address, sizeof(address));
+    }
+  }
+  os.close();
+  if (!os) {
+    cout << "Error: Failed to write checkpoint " << filename << "." << endl;
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  cout << "Saved checkpoint " << filename << " (" << context.size() << "-byte context, " << cnt << " transactions) in " << delta_us << " us." << endl;
+  return true;
+  #else
+  cout << "Error: Checkpoints require a savable model (SIM_SAVABLE)." << endl;
+  return false;
+  #endif
+}
+
+bool SIM_Kernel::restore_checkpoint(const char * filename) {
+  #ifdef SIM_SAVABLE
+  if (traced_active) {
+    cout << "Error: Cannot restore a checkpoint while tracing." << endl;
+    return false;
+  }
+  std::ifstream is(filename, std::ios::binary);
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  is.read(magic, sizeof(magic));
+  std::string context;
+  // (Contexts of a given model are all the same size.)
+  if (!is || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+      !read_bytes(is, context, reset_context.size()) || context.size() != reset_context.size()) {
+    cout << "Error: " << filename << " is not a checkpoint of this model." << endl;
+    return false;
+  }
+  ReplayLog log;
+  uint8_t truncated = 0;
+  uint64_t cnt = 0;
+  is.read((char *)&truncated, sizeof(truncated));
+  is.read((char *)&cnt, sizeof(cnt));
+  log.truncated = truncated;
+  // (A record over its limit also leaves the stream out of step, so any failure is corruption.)
+  bool ok = (bool)is;
+  for (uint64_t i = 0; ok && i < cnt; i++) {
+    int32_t resp_size = 0;
+    Transaction t;
+    is.read((char *)&resp_size, sizeof(resp_size));
+    t.resp_data_size = resp_size;
+    t.address = 0;
+    ok = read_bytes(is, t.data, MAX_REPLAY_BYTES - log.bytes) && read_bytes(is, t.memory, 4096) &&
+         is.read((char *)&t.address, sizeof(t.address));
+    if (ok) {
+      log.bytes += t.data.size();
+      log.transactions.push_back(t);
+    }
+  }
+  if (!ok) {
+    cout << "Error: Checkpoint " << filename << " is corrupt." << endl;
+    return false;
+  }
+
+  // The current session, and new sessions, start from the checkpoint.
+  base_context = context;
+  base_log = log;
+  restore_context(base_context);
+  replay_logs[cur_session] = ReplayLog();
+  return true;
+  #else
+  cout << "Error: Checkpoints require a savable model (SIM_SAVABLE)." << endl;
+  return false;
+  #endif
+}
+
+void SIM_Kernel::log_transaction(const Transaction &t, bool dropped) {
+  ReplayLog &log = replay_logs[cur_session];
+  if (!log.truncated) {
+    if (dropped || log.bytes + t.data.size() > MAX_REPLAY_BYTES) {
+      log = ReplayLog();
+      log.truncated = true;
+    } else {
+      log.transactions.push_back(t);
+      log.bytes += t.data.size();
+    }
+  }
+  if (traced_active) {
+    traced_sessions.insert(cur_session);
+  }
+}
+
+// Memories are found through Verilator's symbol table, in which public signals are registered by scope. The kernel
+// module's scope is "<model name>." KERNEL_NAME "_kernel", and a memory's scope is that of its enclosing instance.
+VerilatedVar * SIM_Kernel::find_memory(const std::string &memory, std::string &error) {
+  std::string scope_name = std::string(traced_active ? "TRACED" : "TOP") + "." KERNEL_NAME "_kernel";
+  std::string var_name = memory;
+  size_t dot = memory.rfind('.');
+  if (dot != std::string::npos) {
+    scope_name += "." + memory.substr(0, dot);
+    var_name = memory.substr(dot + 1);
+  }
+  const VerilatedScope * scope = (const VerilatedScope *)svGetScopeFromName(scope_name.c_str());
+  VerilatedVar * var = scope ? scope->varFind(var_name.c_str()) : NULL;
+  if (!var) {
+    error = "No public memory " + memory + " (scope " + scope_name + ").";
+    return NULL;
+  }
+  if (var->udims() != 1) {
+    error = memory + " is not a one-dimensional memory.";
+    return NULL;
+  }
+  return var;
+}
+
+bool SIM_Kernel::write_memory(const std::string &memory, int64_t address, const std::string &entries, std::string &error) {
+  VerilatedVar * var = find_memory(memory, error);
+  if (!var) {
+    return false;
+  }
+  size_t entry_bytes = var->entSize();
+  int64_t cnt = entries.size() / entry_bytes;
+  if (address < var->unpacked().low() || address + cnt - 1 > var->unpacked().high()) {
+    error = "Entries " + std::to_string(address) + ".." + std::to_string(address + cnt - 1) + " exceed the bounds of " + memory + ".";
+    return false;
+  }
+  for (int64_t i = 0; i < cnt; i++) {
+    memcpy(var->datapAdjustIndex(var->datap(), 1, address + i), entries.data() + i * entry_bytes, entry_bytes);
+  }
+  return true;
+}
+
+int SIM_Kernel::load_memory(const char * memory, int64_t address, const nlohmann::json &data, std::string &error) {
+  VerilatedVar * var = find_memory(memory, error);
+  if (!var) {
+    return -1;
+  }
+  if (!data.is_array()) {
+    error = "Memory data must be an array of entries.";
+    return -1;
+  }
+  // Convert entries to the model's representation: little-endian integers of entSize() bytes (whole 32-bit words for
+  // wide entries), with no bits set beyond the entry's width.
+  size_t entry_bytes = var->entSize();
+  int width = var->packed().elements();
+  std::vector<uint32_t> words((entry_bytes + 3) / 4);
+  Transaction t;
+  t.memory = memory;
+  t.address = address;
+  t.resp_data_size = 0;
+  t.data.reserve(data.size() * entry_bytes);
+  for (const nlohmann::json &entry : data) {
+    bool valid = entry.is_number_unsigned() || (entry.is_array() && entry.size() <= words.size());
+    for (size_t w = 0; valid && entry.is_array() && w < entry.size(); w++) {
+      valid = entry[w].is_number_unsigned();
+    }
+    if (!valid) {
+      error = "Invalid entry for " + t.memory + ": " + entry.dump();
+      return -1;
+    }
+    std::fill(words.begin(), words.end(), 0);
+    if (entry.is_array()) {
+      for (size_t w = 0; w < entry.size(); w++) {
+        words[w] = entry[w].get<uint32_t>();
+      }
+    } else {
+      uint64_t value = entry.get<uint64_t>();
+      words[0] = (uint32_t)value;
+      if (words.size() > 1) {words[1] = (uint32_t)(value >> 32);}
+    }
+    for (int w = 0; w < (int)words.size(); w++) {
+      if (width < (w + 1) * 32) {
+        words[w] &= (width <= w * 32) ? 0 : (0xFFFFFFFFu >> ((w + 1) * 32 - width));
+      }
+    }
+    t.data.append((const char *)words.data(), entry_bytes);
+  }
+  if (!write_memory(t.memory, address, t.data, error)) {
+    return -1;
+  }
+  log_transaction(t);
+  return data.size();
 }
 
 void SIM_Kernel::writeKernelData(void * input, int data_size, int resp_data_size) {
   input_buff = input;
-  output_buff = new uint32_t[(resp_data_size/HostApp::DATA_WIDTH_BYTES)*HostApp::DATA_WIDTH_WORDS];
   this->data_size = data_size/HostApp::DATA_WIDTH_BYTES;
-  this->resp_data_size = resp_data_size/HostApp::DATA_WIDTH_BYTES;
+  this->resp_data_size = (resp_data_size < 0) ? RESP_UNBOUNDED : resp_data_size/HostApp::DATA_WIDTH_BYTES;
 }
 
 void SIM_Kernel::write_kernel_data(input_struct * input, int data_size) {
-  uint resp_length = (uint)(input->width * input->height) / HostApp::DATA_WIDTH_WORDS;
-  cout << "Verilator: (" << input->width << "x" << input->height << "), resp_length = " << resp_length << endl;
+  uint resp_length = (uint)input_struct_pixels(input, data_size) / HostApp::DATA_WIDTH_WORDS;
+  cout << "Verilator: (" << input->width << "x" << input->height << (data_size > HostApp::DATA_WIDTH_BYTES ? ", ..." : "") << "), resp_length = " << resp_length << endl;
 
   input_buff = input;
-  output_buff = new uint32_t [resp_length*HostApp::DATA_WIDTH_WORDS];
   this->data_size = data_size/HostApp::DATA_WIDTH_BYTES;
   this->resp_data_size = resp_length;
 }
@@ -146,52 +664,204 @@ void SIM_Kernel::write_kernel_data(input_struct * input, int data_size) {
 
 // A data buffer is available to send.
 void SIM_Kernel::start_kernel() {
-  verilator_kernel->clk = 0;
+  if (resp_data_size < 0) {
+    perror("Error: An unbounded response must be streamed.\n");
+    resp_words = 0;
+    return;
+  }
+  output_buff = (uint32_t *)BufferPool::shared().alloc(resp_data_size*HostApp::DATA_WIDTH_BYTES);
+  resp_words = run_kernel(output_buff, resp_data_size, NULL);
+}
+
+void SIM_Kernel::stream_kernel(KernelOutputSink &sink, int batch_words) {
+  uint32_t * batch_buff = (uint32_t *)BufferPool::shared().alloc(batch_words*HostApp::DATA_WIDTH_BYTES);
+  run_kernel(batch_buff, batch_words, &sink);
+  BufferPool::shared().release(batch_buff);
+}
+
+void SIM_Kernel::stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words) {
+  writeKernelData(NULL, data_size, resp_data_size);
+  input_source = &source;
+  input_base = input_words = 0;
+  streamed_input_dropped = false;
+  stream_kernel(sink, batch_words);
+  input_source = NULL;
+  input_base = input_words = 0;
+}
+
+const uint32_t * SIM_Kernel::input_word(unsigned int word) {
+  if (input_source && word >= input_base + input_words) {
+    int words = 0;
+    input_base += input_words;
+    input_buff = (void *)input_source->produce(words);
+    input_words = input_buff ? words : 0;
+    if (input_words == 0) {
+      cout << "Warning: Kernel input ended after " << word << " of " << data_size << " words." << endl;
+      data_size = word;
+      return NULL;
+    }
+    // Keep the input for the replay log, within its limit.
+    size_t bytes = (size_t)input_words * HostApp::DATA_WIDTH_BYTES;
+    if (!streamed_input_dropped && streamed_input.size() + bytes > MAX_REPLAY_BYTES) {
+      streamed_input_dropped = true;
+      std::string().swap(streamed_input);
+    }
+    if (!streamed_input_dropped) {
+      streamed_input.append((const char *)input_buff, bytes);
+    }
+  }
+  return &((const uint32_t *)input_buff)[(word - input_base) * HostApp::DATA_WIDTH_WORDS];
+}
+
+unsigned int SIM_Kernel::run_kernel(uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink) {
+  // Log the inputs, to reconstruct this context in the other model. (Streamed input is logged once received.)
+  Transaction t;
+  t.resp_data_size = resp_data_size;
+  t.address = 0;
+  if (!input_source) {
+    t.data.assign((const char *)input_buff, data_size * HostApp::DATA_WIDTH_BYTES);
+    log_transaction(t);
+  }
+
+  struct timespec start_time;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  unsigned int recv_cntr = traced_active ? run_model(traced_kernel, buff, buff_words, sink)
+                                         : run_model(verilator_kernel, buff, buff_words, sink);
+  if (input_source) {
+    t.data.swap(streamed_input);
+    log_transaction(t, streamed_input_dropped);
+  }
+
+  // Report throughput. (For streams, this includes time in the sink.)
+  struct timespec end_time;
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  last_perf = run_perf;
+  last_perf.transactions = 1;
+  last_perf.seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+  total_perf.add(last_perf);
+  cout << "Simulated " << last_perf.cycles << " cycles in " << last_perf.seconds * 1000.0 << " ms ("
+       << (last_perf.seconds > 0.0 ? (uint64_t)(last_perf.cycles / last_perf.seconds) : 0) << " cycles/s, "
+       << last_perf.in_stall_cycles << " input stall cycles, " << last_perf.out_bubble_cycles << " output bubble cycles)." << endl;
+
+  return recv_cntr;
+}
+
+template <typename M>
+unsigned int SIM_Kernel::run_model(M * model, uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink) {
+  model->clk = 0;
+  run_start_phase = phase_cnt;
 
   unsigned int send_cntr=0;
   unsigned int recv_cntr=0;
+  unsigned int buff_cntr=0;  // Words in buff.
+  unsigned int cycle_cntr=0;
+  bool resp_done = resp_data_size == 0;  // The response is complete (full or out_last).
+  bool resp_last = false;  // The kernel asserted out_last, ending the transaction.
+  bool idle = false;  // The kernel is quiescent with nothing more to send, so no more output can come.
+  struct timespec flush_time;
+  if (sink) {clock_gettime(CLOCK_MONOTONIC, &flush_time);}
+  run_perf = Perf();
 
-  while ((send_cntr < data_size) || (recv_cntr < resp_data_size)) {
-    tick();
+  while (!resp_last && !idle && ((send_cntr < data_size) || !resp_done)) {
+    tick(model);
+    run_perf.cycles++;
 
-    if(recv_cntr < resp_data_size) {
-      verilator_kernel->out_ready = 1;
-    } else {
-      verilator_kernel->out_ready = 0;
+    // The model is evaluated only on clock edges, except when out_ready changes (at the start and end of the response),
+    // in case it combinationally affects the signals read below (as in vadd, which is purely combinational).
+    // SIM_SETTLE_EVAL evaluates every cycle, for kernels that need it.
+    #ifndef SIM_SETTLE_EVAL
+    if (model->out_ready != !resp_done)
+    #endif
+    {
+      model->out_ready = !resp_done;
+      model->eval();
     }
-    //For the case where out_ready combinatorially effects the signals read in the code below. Such as vadd, which is purely combinatorial.
-    //TODO: unnecessary overhead in most cases, migh want a mechanism to diasble
-    verilator_kernel->eval();
   
-    if(recv_cntr < resp_data_size && verilator_kernel->out_avail) {
-      uint32_t * output = (uint32_t *)output_buff;
+    if(!resp_done && model->out_avail) {
       for(int words = 0; words < HostApp::DATA_WIDTH_WORDS; words++) {
-        output[recv_cntr*HostApp::DATA_WIDTH_WORDS + words] = verilator_kernel->out_data[words];
+        buff[buff_cntr*HostApp::DATA_WIDTH_WORDS + words] = model->out_data[words];
       }
       recv_cntr++;
+      buff_cntr++;
+      resp_last = kernel_out_last(model, 0);
+      resp_done = resp_last || (resp_data_size >= 0 && recv_cntr >= (unsigned int)resp_data_size);
       //printf("Verilator recv_cntr: %d\n", recv_cntr);
-    }  
+    } else if (!resp_done) {
+      run_perf.out_bubble_cycles++;
+      // Rather than clocking an idle kernel, end the response.
+      idle = send_cntr >= data_size && kernel_quiescent(model, 0);
+    }
+
+    // When streaming, deliver full batches, and deliver partial batches periodically (checking time only occasionally).
+    if (sink && buff_cntr > 0) {
+      bool flush = buff_cntr == buff_words;
+      if (!flush && (++cycle_cntr & 0xFFF) == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        flush = (now.tv_sec - flush_time.tv_sec) * 1000 + (now.tv_nsec - flush_time.tv_nsec) / 1000000 >= STREAM_FLUSH_MS;
+      }
+      if (flush) {
+        sink->consume(buff, buff_cntr);
+        buff_cntr = 0;
+        clock_gettime(CLOCK_MONOTONIC, &flush_time);
+      }
+    }
 
-    if(send_cntr < data_size) {
-      uint32_t * input = (uint32_t *)input_buff;
-      verilator_kernel->in_avail = 1;
+    const uint32_t * input = (!resp_last && send_cntr < data_size) ? input_word(send_cntr) : NULL;
+    if(input) {
+      model->in_avail = 1;
       for(int words = 0; words < HostApp::DATA_WIDTH_WORDS; words++) {
-        verilator_kernel->in_data[words] = input[send_cntr*HostApp::DATA_WIDTH_WORDS + words];
+        model->in_data[words] = input[words];
       }
-      if(verilator_kernel->in_ready) {
+      if(model->in_ready) {
         //printf("Verilator send_cntr: %d\n", send_cntr);
         send_cntr++;
+      } else {
+        run_perf.in_stall_cycles++;
       }
-      
+
     } else {
-       verilator_kernel->in_avail = 0;
+       model->in_avail = 0;
     }
 
-    tick();
+    tick(model);
+  }
+
+  if (send_cntr < data_size) {
+    cout << "Warning: Kernel asserted out_last having consumed only " << send_cntr << " of " << data_size << " input words." << endl;
+  }
+  if (idle && resp_data_size >= 0) {
+    cout << "Warning: Kernel became quiescent having produced only " << recv_cntr << " of " << resp_data_size << " response words." << endl;
   }
+
+  if (sink && buff_cntr > 0) {
+    sink->consume(buff, buff_cntr);
+  }
+  return recv_cntr;
 }
 
-void SIM_Kernel::read_kernel_data(int h_a_output[], int data_size) {
-  memcpy(h_a_output, output_buff, sizeof(uint32_t)*resp_data_size*HostApp::DATA_WIDTH_WORDS);
-  delete output_buff;
-}
\ No newline at end of file
+int SIM_Kernel::read_kernel_data(int h_a_output[], int data_size) {
+  memcpy(h_a_output, output_buff, sizeof(uint32_t)*resp_words*HostApp::DATA_WIDTH_WORDS);
+  BufferPool::shared().release(output_buff);
+  output_buff = 0;
+  return resp_words * HostApp::DATA_WIDTH_BYTES;
+}
+
+void SIM_Kernel::Perf::to_json(nlohmann::json &j) const {
+  j["cycles"] = cycles;
+  j["in_stall_cycles"] = in_stall_cycles;
+  j["out_bubble_cycles"] = out_bubble_cycles;
+  j["seconds"] = seconds;
+  j["cycles_per_sec"] = (seconds > 0.0) ? (uint64_t)(cycles / seconds) : 0;
+}
+
+void SIM_Kernel::add_stats(nlohmann::json &stats) {
+  stats["threads"] = SIM_THREADS;
+  stats["transactions"] = total_perf.transactions;
+  total_perf.to_json(stats);
+}
+
+void SIM_Kernel::add_perf(nlohmann::json &perf) {
+  last_perf.to_json(perf);
+}
@@ -39,39 +39,195 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "kernel.h"
 #include <stdlib.h>
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
 #include "verilator_kernel.h"
+#include "verilator_kernel_traced.h"
 #include "verilated.h"
+#include "verilated_syms.h"
 #include "server_main.h"
 
+// Traces are FST (compressed) if the traced model is Verilated with --trace-fst (SIM_TRACE_FST), or VCD.
+#ifdef SIM_TRACE_FST
+#include "verilated_fst_c.h"
+typedef VerilatedFstC SimTraceFile;
+#define TRACE_FILE_EXT ".fst"
+#else
+#include "verilated_vcd_c.h"
+typedef VerilatedVcdC SimTraceFile;
+#define TRACE_FILE_EXT ".vcd"
+#endif
+#define TRACE_FILE "../out/sim/trace" TRACE_FILE_EXT
+#define TRACE_PREV_FILE "../out/sim/trace_prev" TRACE_FILE_EXT
+
 #ifndef HEADER_SIM_KERNEL
 #define HEADER_SIM_KERNEL
 
 #define COLS 4096
 #define ROWS 4096
 
+// The number of threads evaluating the model (from the build's SIM_THREADS; Verilator fixes this when Verilating).
+#ifndef SIM_THREADS
+#define SIM_THREADS 1
+#endif
+
 
 
 class SIM_Kernel: public Kernel {
 
 private:
   
-  const static int MAX_PHASES;
-  const static int MAX_TRACE_PHASES;
+  const static uint64_t MAX_PHASES;  // A transaction taking longer than this is considered a kernel hang.
+  const static int STREAM_FLUSH_MS;  // When streaming, deliver a partial batch after this many milliseconds.
+  const static size_t MAX_REPLAY_BYTES;  // Cap on the input data logged for each session (see ReplayLog).
 
+  // The model is Verilated twice: without tracing instrumentation, for normal use, and with it. The traced model is
+  // created and used only while tracing. Switching models transfers the kernel context by replaying inputs.
   VERILATOR_KERNEL *verilator_kernel;
-  VerilatedVcdC* tfp;
+  VERILATOR_KERNEL_TRACED *traced_kernel = NULL;
+  bool traced_active = false;  // The traced model holds the kernel context.
+  SimTraceFile* tfp;
   void* input_buff = 0;
   uint32_t* output_buff = 0;
   unsigned int data_size = 0;
-  unsigned int resp_data_size = 0;
-  int phase_cnt = 0;  // Count of simulation phases.
-  int trace_phase_cnt = 0; // Count of phases in the trace file (valid when tracing_enabled).
+  int resp_data_size = 0;  // Capacity for the response in words, or Kernel::RESP_UNBOUNDED.
+  unsigned int resp_words = 0;  // Words of response received by start_kernel().
+  uint64_t phase_cnt = 0;  // Count of simulation phases.
+  uint64_t run_start_phase = 0;  // phase_cnt at the start of the current transaction.
+  // For input streamed from a source, input_buff holds input_words words of input from word input_base. The input is
+  // accumulated in streamed_input, to be logged (see ReplayLog), unless it is too large (streamed_input_dropped).
+  KernelInputSource * input_source = NULL;
+  unsigned int input_base = 0;
+  unsigned int input_words = 0;
+  std::string streamed_input;
+  bool streamed_input_dropped = false;
+
+  // Tracing keeps a rolling window of (at least) the last trace_window_cycles cycles (or all cycles, if 0), as two
+  // trace files. The current file is rotated to TRACE_PREV_FILE when it reaches the window size.
+  const static uint64_t DEFAULT_TRACE_WINDOW_CYCLES;
+  uint64_t trace_window_cycles = DEFAULT_TRACE_WINDOW_CYCLES;
+  uint64_t trace_phase_cnt = 0; // Count of phases in the current trace file (valid when tracing_enabled).
+  uint64_t traced_phase_cnt = 0; // Count of phases traced since enable_tracing().
+
+  /*
+  ** Start a new trace file, keeping the current one as the previous one.
+  */
+  void rotate_trace();
   bool tracing_enabled = false;
 
+  // Performance counters of a transaction, or accumulated over all transactions (excluding replays).
+  struct Perf {
+    uint64_t transactions = 0;
+    uint64_t cycles = 0;
+    uint64_t in_stall_cycles = 0;  // Cycles with input backpressure (in_avail && !in_ready).
+    uint64_t out_bubble_cycles = 0;  // Cycles awaiting output (out_ready && !out_avail).
+    double seconds = 0.0;  // Wall time.
+    void add(const Perf &p) {
+      transactions += p.transactions;
+      cycles += p.cycles;
+      in_stall_cycles += p.in_stall_cycles;
+      out_bubble_cycles += p.out_bubble_cycles;
+      seconds += p.seconds;
+    }
+    void to_json(nlohmann::json &j) const;
+  };
+  Perf run_perf;  // Counted by run_model(..).
+  Perf last_perf;
+  Perf total_perf;
+
+  // Per-session kernel contexts (requires a model Verilated with --savable, indicated by SIM_SAVABLE).
+  // The model holds the context of cur_session. Other sessions' contexts are held in memory, serialized.
+  std::string cur_session;
+  std::map<std::string, std::string> saved_contexts;
+  std::string reset_context;  // The context following reset_kernel(), for new sessions.
+
+  // The inputs to each session's kernel context since reset, from which the context can be reconstructed in either
+  // model. (The models are not serialization-compatible.)
+  struct Transaction {
+    std::string data;  // Input data, or, for a memory load, the memory entries (in the model's representation).
+    int resp_data_size;
+    std::string memory;  // For a memory load (see load_memory(..)), the memory, else empty.
+    int64_t address;
+  };
+  struct ReplayLog {
+    std::vector<Transaction> transactions;
+    size_t bytes = 0;
+    bool truncated = false;  // Exceeded MAX_REPLAY_BYTES, so the context cannot be reconstructed.
+    bool from_base = true;  // The transactions follow base_log (rather than reset).
+  };
+  std::map<std::string, ReplayLog> replay_logs;
+  // Sessions start from the base context, which is the reset context, or a restored checkpoint and its inputs.
+  std::string base_context;  // Empty if the reset context.
+  ReplayLog base_log;
+  std::set<std::string> traced_sessions;  // Sessions run in the traced model, whose saved contexts are stale.
+
+  /*
+  ** Serialize the model into context, or restore it from context.
+  */
+  void save_context(std::string &context);
+  void restore_context(const std::string &context);
+
   /*
   ** Step test bench
   */
-  void tick();
+  template <typename M>
+  void tick(M * model);
+
+  /*
+  ** Reset the given model.
+  */
+  template <typename M>
+  void reset_model(M * model);
+
+  /*
+  ** Log and run a transaction in the active model, reporting throughput.
+  */
+  unsigned int run_kernel(uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink);
+
+  /*
+  ** Clock the kernel until data_size words are sent and the response is complete (resp_data_size words are received
+  ** or the kernel asserts out_last). Received words are written to buff, which holds buff_words words. If sink is
+  ** non-NULL, buff is passed to sink when full (or after STREAM_FLUSH_MS), and reused.
+  ** Returns the number of words received.
+  */
+  template <typename M>
+  unsigned int run_model(M * model, uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink);
+  /*
+  ** The input word of the given index, requesting input from input_source as needed. Returns NULL (and shortens
+  ** data_size) if the input ends early.
+  */
+  const uint32_t * input_word(unsigned int word);
+
+  /*
+  ** Install the context of the given session in the active model, from its saved context, or by replaying its inputs.
+  */
+  void load_context(const std::string &session);
+  /*
+  ** Rerun the logged transactions in the active model. Returns false if the log is truncated (running nothing).
+  */
+  bool replay(const ReplayLog &log);
+
+  /*
+  ** Switch the kernel context to the traced or untraced model.
+  */
+  void use_traced_model(bool traced);
+
+  /*
+  ** Find a memory of the active model by its hierarchical name within the kernel (e.g. "core.imem"), or return NULL
+  ** with an explanation in error. The memory must be declared public (with a "verilator public" metacomment).
+  */
+  VerilatedVar * find_memory(const std::string &memory, std::string &error);
+  /*
+  ** Write entries (in the model's representation) to memory in the active model, starting at address.
+  */
+  bool write_memory(const std::string &memory, int64_t address, const std::string &entries, std::string &error);
+  /*
+  ** Log a transaction of the current session (see ReplayLog), or, if dropped (its input was too large to keep), mark
+  ** the log truncated.
+  */
+  void log_transaction(const Transaction &t, bool dropped = false);
 
 public:
 
@@ -107,6 +263,10 @@ public:
   ** Saves trace waveform
   */
   void save_trace();
+  /*
+  ** Set the size of the rolling trace window in cycles (0 for unlimited)
+  */
+  void set_trace_window(uint64_t cycles) {trace_window_cycles = cycles;}
   
   /*
   ** Performs reset on user kernel
@@ -117,9 +277,47 @@ public:
   */
   void start_kernel();
   /*
-  ** Copy received data to an output buffer
+  ** Copy received data to an output buffer, returning its size in bytes
+  */
+  int read_kernel_data(int h_a_output[], int data_size);
+  /*
+  ** Starts computation, streaming the received data to sink
+  */
+  void stream_kernel(KernelOutputSink &sink, int batch_words);
+  /*
+  ** As above, taking input from source as the simulation consumes it
+  */
+  void stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words);
+
+  /*
+  ** Switch kernel contexts, reporting the time taken
+  */
+  void select_session(const char * session);
+  /*
+  ** Discard a kernel context
+  */
+  void end_session(const char * session);
+
+  /*
+  ** Save the current kernel context to a checkpoint file, or restore it (as the starting context of new sessions)
+  ** from one (requires SIM_SAVABLE)
+  */
+  bool save_checkpoint(const char * filename);
+  bool restore_checkpoint(const char * filename);
+
+  /*
+  ** Write memory entries directly through the model's public signals
+  */
+  int load_memory(const char * memory, int64_t address, const nlohmann::json &data, std::string &error);
+
+  /*
+  ** Report simulation throughput (cycles/second) for STATS
+  */
+  void add_stats(nlohmann::json &stats);
+  /*
+  ** Report performance counters of the last transaction
   */
-  void read_kernel_data(int h_a_output[], int data_size);
+  void add_perf(nlohmann::json &perf);
 };
 
 #endif
@@ -0,0 +1,234 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** This library runs a software model of the user kernel (see sw_model.h) for the sw build target.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <iostream>
+#include "kernel.h"
+#include "sw_kernel.h"
+#include "buffer_pool.h"
+
+using namespace std;
+
+
+const int SW_Kernel::MAX_STALLS = 1000;
+
+SW_Kernel::SW_Kernel() {
+}
+
+SW_Kernel::~SW_Kernel() {
+  clean_kernel();
+}
+
+void SW_Kernel::perror(const char * msg) {
+  cout << msg;
+  status = EXIT_FAILURE;
+}
+
+void * SW_Kernel::lookup(const char * name) {
+  void * sym = dlsym(lib, name);
+  if (sym == NULL) {
+    cout << "Software model does not define " << name << "(..)." << endl;
+    perror("Error: Failed to load software model.\n");
+  }
+  return sym;
+}
+
+void SW_Kernel::load_model(const char * lib_path) {
+  lib = dlopen(lib_path, RTLD_NOW | RTLD_LOCAL);
+  if (lib == NULL) {
+    cout << dlerror() << endl;
+    perror("Error: Failed to open software model library.\n");
+    return;
+  }
+  model_create  = (sw_model_create_fn) lookup("sw_model_create");
+  model_destroy = (sw_model_destroy_fn)lookup("sw_model_destroy");
+  model_reset   = (sw_model_reset_fn)  lookup("sw_model_reset");
+  model_in      = (sw_model_in_fn)     lookup("sw_model_in");
+  model_out     = (sw_model_out_fn)    lookup("sw_model_out");
+  if (!model_create || !model_destroy || !model_reset || !model_in || !model_out) {
+    dlclose(lib);
+    lib = NULL;
+    return;
+  }
+
+  model = model_create();
+  if (model == NULL) {
+    perror("Error: Software model failed to construct.\n");
+    return;
+  }
+  status = 0;
+  initialized = true;
+  cout << "Loaded software model " << lib_path << endl;
+}
+
+void SW_Kernel::reset_kernel() {
+  model_reset(model);
+}
+
+void SW_Kernel::writeKernelData(void * input, int data_size, int resp_data_size) {
+  input_buff = input;
+  this->data_size = data_size / 4 / SW_MODEL_DATA_WORDS;
+  this->resp_data_size = (resp_data_size < 0) ? RESP_UNBOUNDED : resp_data_size / 4 / SW_MODEL_DATA_WORDS;
+}
+
+void SW_Kernel::write_kernel_data(input_struct * input, int data_size) {
+  uint resp_length = (uint)input_struct_pixels(input, data_size) / SW_MODEL_DATA_WORDS;
+
+  input_buff = input;
+  this->data_size = data_size / 4 / SW_MODEL_DATA_WORDS;
+  this->resp_data_size = resp_length;
+}
+
+void SW_Kernel::start_kernel() {
+  if (resp_data_size < 0) {
+    perror("Error: An unbounded response must be streamed.\n");
+    resp_words = 0;
+    return;
+  }
+  output_buff = (uint32_t *)BufferPool::shared().alloc(resp_data_size * SW_MODEL_DATA_WORDS * 4);
+  resp_words = run_kernel(output_buff, resp_data_size, NULL);
+}
+
+void SW_Kernel::stream_kernel(KernelOutputSink &sink, int batch_words) {
+  uint32_t * batch_buff = (uint32_t *)BufferPool::shared().alloc(batch_words * SW_MODEL_DATA_WORDS * 4);
+  run_kernel(batch_buff, batch_words, &sink);
+  BufferPool::shared().release(batch_buff);
+}
+
+void SW_Kernel::stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words) {
+  writeKernelData(NULL, data_size, resp_data_size);
+  input_source = &source;
+  input_base = input_words = 0;
+  input_ended = false;
+  stream_kernel(sink, batch_words);
+  input_source = NULL;
+  input_base = input_words = 0;
+}
+
+const uint32_t * SW_Kernel::input_word(unsigned int word) {
+  if (input_source && word >= input_base + input_words) {
+    int words = 0;
+    input_base += input_words;
+    input_buff = (void *)input_source->produce(words);
+    input_words = input_buff ? words : 0;
+    if (input_words == 0) {
+      cout << "Warning: Input ended after " << word << " of " << data_size << " words." << endl;
+      data_size = word;
+      input_ended = true;
+      return NULL;
+    }
+  }
+  return &((const uint32_t *)input_buff)[(word - input_base) * SW_MODEL_DATA_WORDS];
+}
+
+// Stream the input through the model, alternating output and input transfers as a clocked kernel would.
+unsigned int SW_Kernel::run_kernel(uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink) {
+  unsigned int send_cntr = 0;
+  unsigned int recv_cntr = 0;
+  unsigned int buff_cntr = 0;  // Words in buff.
+  int stall_cnt = 0;
+  bool resp_done = resp_data_size == 0;  // The response is complete (full or SW_MODEL_OUT_LAST).
+  bool resp_last = false;  // The model returned SW_MODEL_OUT_LAST, ending the transaction.
+
+  while (!resp_last && ((send_cntr < data_size) || !resp_done)) {
+    bool progress = false;
+
+    int out = resp_done ? 0 : model_out(model, &buff[buff_cntr * SW_MODEL_DATA_WORDS]);
+    if (out) {
+      recv_cntr++;
+      buff_cntr++;
+      progress = true;
+      resp_last = out == SW_MODEL_OUT_LAST;
+      resp_done = resp_last || (resp_data_size >= 0 && recv_cntr >= (unsigned int)resp_data_size);
+      if (sink && buff_cntr == buff_words) {
+        sink->consume(buff, buff_cntr);
+        buff_cntr = 0;
+      }
+    }
+
+    const uint32_t * in = (!resp_last && send_cntr < data_size) ? input_word(send_cntr) : NULL;
+    if (in && model_in(model, in)) {
+      send_cntr++;
+      progress = true;
+    }
+
+    if (progress) {
+      stall_cnt = 0;
+    } else if (++stall_cnt > MAX_STALLS) {
+      if (input_ended) {
+        cout << "Warning: Software model response ended early, with its input." << endl;
+        break;
+      }
+      // Like a simulated kernel that fails to complete, this is fatal.
+      cout << "Software model stalled after consuming " << send_cntr << " of " << data_size
+           << " and producing " << recv_cntr << " words. Exiting." << endl;
+      exit(1);
+    }
+  }
+
+  if (send_cntr < data_size) {
+    cout << "Warning: Software model ended its response having consumed only " << send_cntr << " of " << data_size << " input words." << endl;
+  }
+
+  if (sink && buff_cntr > 0) {
+    sink->consume(buff, buff_cntr);
+  }
+  return recv_cntr;
+}
+
+int SW_Kernel::read_kernel_data(int h_a_output[], int data_size) {
+  memcpy(h_a_output, output_buff, sizeof(uint32_t) * resp_words * SW_MODEL_DATA_WORDS);
+  BufferPool::shared().release(output_buff);
+  output_buff = 0;
+  return resp_words * 4 * SW_MODEL_DATA_WORDS;
+}
+
+void SW_Kernel::clean_kernel() {
+  if (model != NULL) {
+    model_destroy(model);
+    model = NULL;
+  }
+  if (lib != NULL) {
+    dlclose(lib);
+    lib = NULL;
+  }
+  initialized = false;
+}
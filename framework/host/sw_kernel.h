@@ -0,0 +1,147 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** This library runs a software model of the user kernel (see sw_model.h) for the sw build target.
+**
+*/
+
+
+#include "kernel.h"
+#include <stdlib.h>
+#include "sw_model.h"
+
+#ifndef HEADER_SW_KERNEL
+#define HEADER_SW_KERNEL
+
+
+
+class SW_Kernel: public Kernel {
+
+private:
+
+  // Give up on a model that makes no progress for this many consecutive attempts.
+  const static int MAX_STALLS;
+
+  void * lib = NULL;    // Handle of the loaded shared library.
+  void * model = NULL;  // The model's state.
+  sw_model_create_fn  model_create;
+  sw_model_destroy_fn model_destroy;
+  sw_model_reset_fn   model_reset;
+  sw_model_in_fn      model_in;
+  sw_model_out_fn     model_out;
+
+  void* input_buff = 0;
+  uint32_t* output_buff = 0;
+  unsigned int data_size = 0;
+  int resp_data_size = 0;  // Capacity for the response in words, or Kernel::RESP_UNBOUNDED.
+  unsigned int resp_words = 0;  // Words of response received by start_kernel().
+  // For input streamed from a source, input_buff holds input_words words of input from word input_base.
+  KernelInputSource * input_source = NULL;
+  unsigned int input_base = 0;
+  unsigned int input_words = 0;
+  bool input_ended = false;  // The streamed input ended early, so the response may not be completed.
+
+  /*
+  ** Look up a function in the loaded library, reporting an error if it is missing.
+  */
+  void * lookup(const char * name);
+
+  /*
+  ** Stream data_size words through the model, receiving up to resp_data_size words (ending sooner if the model
+  ** returns SW_MODEL_OUT_LAST). Received words are written to buff, which holds buff_words words. If sink is
+  ** non-NULL, buff is passed to sink when full, and reused.
+  ** Returns the number of words received.
+  */
+  unsigned int run_kernel(uint32_t * buff, unsigned int buff_words, KernelOutputSink * sink);
+  /*
+  ** The input word of the given index, requesting input from input_source as needed. Returns NULL (and shortens
+  ** data_size) if the input ends early.
+  */
+  const uint32_t * input_word(unsigned int word);
+
+public:
+
+  int status = 1;
+  bool initialized = false;
+
+  SW_Kernel();
+  ~SW_Kernel();
+
+  void perror(const char * msg);
+
+  /*
+  ** Load the model from the given shared library and construct it.
+  ** On success, initialized is true.
+  */
+  void load_model(const char * lib_path);
+
+  /***************************************
+  **                                    **
+  ** Software Model Interface functions **
+  **                                    **
+  ****************************************/
+
+  /*
+  ** Save the pointer to the input data
+  */
+  void writeKernelData(void * input, int data_size, int resp_data_size);
+  void write_kernel_data(input_struct * input, int data_size);
+
+  /*
+  ** Resets the model
+  */
+  void reset_kernel();
+  /*
+  ** Streams the input data through the model, collecting the response
+  */
+  void start_kernel();
+  /*
+  ** Copy received data to an output buffer, returning its size in bytes
+  */
+  int read_kernel_data(int h_a_output[], int data_size);
+  /*
+  ** Streams the input data through the model, delivering the response to sink in batches
+  */
+  void stream_kernel(KernelOutputSink &sink, int batch_words);
+  /*
+  ** As above, taking input from source as the model consumes it
+  */
+  void stream_kernel(KernelInputSource &source, int data_size, int resp_data_size, KernelOutputSink &sink, int batch_words);
+  /*
+  ** Destroys the model and unloads the library
+  */
+  void clean_kernel();
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** This header defines the interface between the host application and a software model of the user kernel.
+** It is used by the sw build target, where no RTL is available.
+**
+** A model is a shared library, built from the app's host/model/ sources, that is loaded by the host
+** application at runtime (see sw_kernel.h). It implements the 512-bit streaming interface of the
+** kernel module (see kernel_module.tlvlib) at the transaction level, without a clock:
+**    - sw_model_in   --> the host offers an input word (in_avail); the model returns non-zero if it
+**                        accepted the word (in_ready)
+**    - sw_model_out  --> the host is ready for an output word (out_ready); the model returns non-zero
+**                        if it produced a word (out_avail), or SW_MODEL_OUT_LAST if that word is the
+**                        last of the response (out_last)
+**
+** A model that neither accepts an input nor produces an output when offered both is considered stuck.
+**
+** Models include this file and define each of the functions below with C linkage.
+*/
+
+#ifndef HEADER_SW_MODEL
+#define HEADER_SW_MODEL
+
+#include <stdint.h>
+
+// 32-bit words per 512-bit data word.
+#define SW_MODEL_DATA_WORDS 16
+// sw_model_out(..) return value marking the last word of a response.
+#define SW_MODEL_OUT_LAST 2
+
+extern "C" {
+
+  /*
+  ** Construct the model, returning a pointer to its state (passed to the functions below).
+  */
+  void * sw_model_create();
+  /*
+  ** Destroy the model.
+  */
+  void sw_model_destroy(void * model);
+  /*
+  ** Equivalent to asserting the kernel's reset.
+  */
+  void sw_model_reset(void * model);
+  /*
+  ** Offer an input word. Returns non-zero if accepted.
+  */
+  int sw_model_in(void * model, const uint32_t in_data[SW_MODEL_DATA_WORDS]);
+  /*
+  ** Request an output word. Returns non-zero if out_data was populated, or SW_MODEL_OUT_LAST if it is the last word of
+  ** the response.
+  */
+  int sw_model_out(void * model, uint32_t out_data[SW_MODEL_DATA_WORDS]);
+
+}
+
+// Function types, used to look up the above functions in the loaded model.
+typedef void * (*sw_model_create_fn)();
+typedef void   (*sw_model_destroy_fn)(void * model);
+typedef void   (*sw_model_reset_fn)(void * model);
+typedef int    (*sw_model_in_fn)(void * model, const uint32_t in_data[SW_MODEL_DATA_WORDS]);
+typedef int    (*sw_model_out_fn)(void * model, uint32_t out_data[SW_MODEL_DATA_WORDS]);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Steven F. Hoover
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+**
+** Compile-time layouts of fields within the kernel's 512-bit data word.
+**
+** An app declares the fields of its word once, each with a name, a C++ type, a bit offset, and a width, and lists them
+** in a WordLayout:
+**
+**   WORD_FIELD(Opcode, uint32_t, 0, 8);
+**   WORD_FIELD(Addr, uint64_t, 8, 40);
+**   WORD_FIELD(Scale, double, 64, 64);
+**   typedef WordLayout<Opcode, Addr, Scale> MyWord;
+**
+**   constexpr KernelWord w = MyWord::pack(3, 0x1000, 0.5);  // (constexpr for integer fields)
+**   uint64_t addr = MyWord::get<Addr>(w);
+**   MyWord::set<Opcode>(word, 4);
+**
+** Fields are packed and unpacked by shifts and masks fixed at compile time. Bad fields (out of range, too wide for
+** their type), overlapping fields, and use of a field not in the layout are compile-time errors. Integer fields
+** narrower than their type are truncated when packed and, if signed, sign-extended when unpacked. double fields are
+** 64-bit IEEE-754.
+**
+** The word, as KernelWord, holds 16 32-bit values, least-significant first, as in kernel buffers and DATA_MSG JSON.
+** A layout also provides codecs between words and JSON objects of named fields, and binary data in kernel buffers.
+**
+*/
+
+#ifndef HEADER_WORD_LAYOUT
+#define HEADER_WORD_LAYOUT
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+
+static const int KERNEL_WORD_BITS = 512;
+
+struct KernelWord {
+  uint32_t w[KERNEL_WORD_BITS / 32];
+};
+
+
+/*
+** Conversion of a field's value to and from the (up to 64) bits of the field.
+*/
+template <typename T, bool Integral = std::is_integral<T>::value>
+struct WordFieldCodec;
+
+template <typename T>
+struct WordFieldCodec<T, true> {
+  static const int max_width = std::is_same<T, bool>::value ? 1 : (int)sizeof(T) * 8;
+  static constexpr uint64_t to_bits(T value) {return (uint64_t)value;}
+  // (Sign extension of a signed field narrower than 64 bits is applied by WordField.)
+  static constexpr T from_bits(uint64_t bits) {return (T)bits;}
+};
+
+template <>
+struct WordFieldCodec<double, false> {
+  static const int max_width = 64;
+  static uint64_t to_bits(double value) {uint64_t bits; memcpy(&bits, &value, 8); return bits;}
+  static double from_bits(uint64_t bits) {double value; memcpy(&value, &bits, 8); return value;}
+};
+
+
+/*
+** A field of WIDTH bits at bit OFFSET of the word, holding a value of type T. (Declare fields with WORD_FIELD.)
+*/
+template <typename T, int OFFSET, int WIDTH>
+struct WordField {
+  typedef T type;
+  typedef WordFieldCodec<T> codec;
+  static const int offset = OFFSET;
+  static const int width = WIDTH;
+
+  static_assert(WIDTH > 0 && WIDTH <= 64, "A word field must be 1 to 64 bits wide.");
+  static_assert(OFFSET >= 0 && OFFSET + WIDTH <= KERNEL_WORD_BITS, "A word field must lie within the kernel word.");
+  static_assert(WIDTH <= codec::max_width, "A word field is wider than its type.");
+  static_assert(std::is_integral<T>::value || WIDTH == 64, "A double word field must be 64 bits wide.");
+
+  static constexpr uint64_t mask() {return WIDTH == 64 ? ~(uint64_t)0 : ((uint64_t)1 << (WIDTH % 64)) - 1;}
+  static constexpr int first_element() {return OFFSET / 32;}
+  static constexpr int last_element() {return (OFFSET + WIDTH - 1) / 32;}
+
+  // The field's bits within 32-bit element i of the word, for the given field bits.
+  static constexpr uint32_t element(int i, uint64_t bits) {
+    return (i < first_element() || i > last_element()) ? 0u :
+           (OFFSET >= i * 32) ? (uint32_t)((bits & mask()) << (OFFSET - i * 32)) :
+                                (uint32_t)((bits & mask()) >> (i * 32 - OFFSET));
+  }
+  // The field's bits, gathered from elements i onward.
+  static constexpr uint64_t gather(const KernelWord &word, int i) {
+    return (i > last_element()) ? 0 :
+           (((i * 32 >= OFFSET) ? (uint64_t)word.w[i] << (i * 32 - OFFSET) : (uint64_t)word.w[i] >> (OFFSET - i * 32)) |
+            gather(word, i + 1));
+  }
+  // The field's bits, sign-extended for signed types.
+  static constexpr uint64_t extend(uint64_t bits) {
+    return (std::is_signed<T>::value && WIDTH < 64 && ((bits >> (WIDTH - 1)) & 1)) ? bits | ~mask() : bits;
+  }
+
+  static constexpr T get(const KernelWord &word) {
+    return codec::from_bits(extend(gather(word, first_element()) & mask()));
+  }
+  static void set(KernelWord &word, T value) {
+    uint64_t bits = codec::to_bits(value);
+    for (int i = first_element(); i <= last_element(); i++) {
+      word.w[i] = (word.w[i] & ~element(i, ~(uint64_t)0)) | element(i, bits);
+    }
+  }
+};
+
+/*
+** Declare a word field type NAME (whose JSON name is "NAME").
+*/
+#define WORD_FIELD(NAME, TYPE, OFFSET, WIDTH) \
+  struct NAME : WordField<TYPE, OFFSET, WIDTH> {static constexpr const char * name() {return #NAME;}}
+
+
+/*
+** Compile-time helpers over lists of fields.
+*/
+template <typename... Fields>
+struct WordFields {
+  static constexpr bool overlap() {return false;}
+  template <typename F> static constexpr bool contains() {return false;}
+  template <int I> static constexpr uint32_t element() {return 0u;}
+};
+
+template <typename F, typename... Fs>
+struct WordFields<F, Fs...> {
+  // F overlaps G.
+  template <typename G> static constexpr bool overlaps() {
+    return F::offset < G::offset + G::width && G::offset < F::offset + F::width;
+  }
+  // Any two of the fields overlap.
+  static constexpr bool overlap() {return any(WordFields<F>::template overlaps<Fs>()...) || WordFields<Fs...>::overlap();}
+  template <typename G> static constexpr bool contains() {return std::is_same<F, G>::value || WordFields<Fs...>::template contains<G>();}
+  // Element I of the word with the given field values.
+  template <int I> static constexpr uint32_t element(typename F::type value, typename Fs::type... values) {
+    return F::element(I, F::codec::to_bits(value)) | WordFields<Fs...>::template element<I>(values...);
+  }
+  static constexpr bool any() {return false;}
+  template <typename... Bs> static constexpr bool any(bool b, Bs... bs) {return b || any(bs...);}
+};
+
+// A list of the integers 0..N-1 (for pack expansion).
+template <int... Is> struct WordIndices {};
+template <int N, int... Is> struct MakeWordIndices : MakeWordIndices<N - 1, N - 1, Is...> {};
+template <int... Is> struct MakeWordIndices<0, Is...> {typedef WordIndices<Is...> type;};
+
+
+/*
+** The layout of a kernel word, as a list of WordFields.
+*/
+template <typename... Fields>
+class WordLayout {
+  static_assert(!WordFields<Fields...>::overlap(), "Fields of a word layout overlap.");
+
+  template <int... Is>
+  static constexpr KernelWord pack(WordIndices<Is...>, typename Fields::type... values) {
+    return KernelWord{{WordFields<Fields...>::template element<Is>(values...)...}};
+  }
+
+public:
+  static const int num_fields = sizeof...(Fields);
+
+  /*
+  ** A word with the given values of all fields, in the order of the layout (and other bits zero).
+  */
+  static constexpr KernelWord pack(typename Fields::type... values) {
+    return pack(typename MakeWordIndices<KERNEL_WORD_BITS / 32>::type(), values...);
+  }
+
+  /*
+  ** Get or set a field.
+  */
+  template <typename F>
+  static constexpr typename F::type get(const KernelWord &word) {
+    static_assert(WordFields<Fields...>::template contains<F>(), "Field is not in this word layout.");
+    return F::get(word);
+  }
+  template <typename F>
+  static void set(KernelWord &word, typename F::type value) {
+    static_assert(WordFields<Fields...>::template contains<F>(), "Field is not in this word layout.");
+    F::set(word, value);
+  }
+
+  /*
+  ** JSON codec: an object with a member per field, by name. A word may also be decoded from its DATA_MSG form, an
+  ** array of 16 32-bit values (least-significant first). Missing fields are zero.
+  */
+  static nlohmann::json to_json(const KernelWord &word) {
+    nlohmann::json j = nlohmann::json::object();
+    int expand[] = {0, (j[Fields::name()] = Fields::get(word), 0)...};
+    (void)expand;
+    return j;
+  }
+  static KernelWord from_json(const nlohmann::json &j) {
+    KernelWord word = {};
+    if (j.is_array()) {
+      for (int i = 0; i < KERNEL_WORD_BITS / 32 && i < (int)j.size(); i++) {
+        word.w[i] = j[i];
+      }
+    } else {
+      int expand[] = {0, (j.count(Fields::name()) ? Fields::set(word, j[Fields::name()].template get<typename Fields::type>()) : (void)0, 0)...};
+      (void)expand;
+    }
+    return word;
+  }
+
+  /*
+  ** Binary codec: words as they are held in kernel buffers (and UPLOAD_DATA_MSG data), as 16 32-bit values each.
+  */
+  static KernelWord read(const void * data) {
+    KernelWord word;
+    memcpy(word.w, data, sizeof(word.w));
+    return word;
+  }
+  static void write(const KernelWord &word, void * data) {
+    memcpy(data, word.w, sizeof(word.w));
+  }
+};
+
+#endif
@@ -78,6 +78,7 @@ import re
 #WRITE_DATA    = "WRITE_DATA"
 #READ_DATA     = "READ_DATA"
 GET_IMAGE     = "GET_IMAGE"
+GET_IMAGES    = "GET_IMAGES"
 
 
 # A simple override of
@@ -94,6 +95,7 @@ class BasicFileHandler(tornado.web.StaticFileHandler):
 class WSHandler(tornado.websocket.WebSocketHandler):
   def open(self, token=None):
     self.token = token
+    self.session = self.application.newSession()
     self.application.newConnection(self)
 
 
@@ -119,6 +121,7 @@ class WSHandler(tornado.websocket.WebSocketHandler):
 
   def on_close(self):
     print('Webserver: Connection closed')
+    self.application.endSession(self)
     oneshot = self.application.args["oneshot"]
     if oneshot != None:
         print ("Webserver: Killing application:", oneshot)
@@ -153,6 +156,14 @@ class IPReqHandler(ReqHandler):
         #ip_str = socket.gethostbyname(socket.gethostname())
         self.write(ip)
 
+"""
+Handler for GET requests for host statistics (JSON). See the host's STATS command.
+"""
+class StatsReqHandler(ReqHandler):
+    def get(self):
+        self.set_header("Content-Type", "application/json")
+        self.write(FPGAServerApplication.application.getStats())
+
 """
 EC2 Action Handlers
 """
@@ -381,6 +392,7 @@ class FPGAServerApplication(tornado.web.Application):
               (r"/()", BasicFileHandler, {"path": FPGAServerApplication.app_dir + "/client/html", "default_filename": "index.html"}),
               (r'/ws', WSHandler),
               (r'/ws/(.*)', WSHandler),
+              (r'/stats', StatsReqHandler),
               (r"/css/(.*\.css)", BasicFileHandler, {"path": FPGAServerApplication.app_dir + "/client/css"}),
               (r"/js/(.*\.js)",   BasicFileHandler, {"path": FPGAServerApplication.app_dir + "/client/js"}),
               (r"/public/(.*)",   BasicFileHandler, {"path": FPGAServerApplication.app_dir + "/client/public"}),
@@ -408,12 +420,76 @@ class FPGAServerApplication(tornado.web.Application):
         response = get_image(self.socket, "GET_IMAGE", payload, True)
         return {'type': 'user', 'png': response}
 
+    # Each WebSocket connection is a session with its own kernel context in the host (for kernels that support it).
+    # The host is told of the session before messages that use the kernel, whenever it changes.
+    def newSession(self):
+        self.session_cnt += 1
+        return str(self.session_cnt)
+
+    def selectSession(self, ws):
+        if ws.session != self.current_session:
+            self.socket.send_string("command", "SELECT_SESSION")
+            self.socket.send_string("session", ws.session)
+            self.current_session = ws.session
+
+    def endSession(self, ws):
+        self.socket.send_string("command", "END_SESSION")
+        self.socket.send_string("session", ws.session)
+        if self.current_session == ws.session:
+            self.current_session = ""
+
     def handleDataMsg(self, data, type, ws):
+        self.selectSession(ws)
         self.socket.send_string("command", type)
         self.socket.send_string("data", data)
         data = read_data_handler(self.socket, None, False)
         return data
 
+    # Handler for UPLOAD_DATA_MSG, which has the form of a DATA_MSG. The data is forwarded to the host in chunks, which
+    # the host feeds to the kernel as they arrive. (The WebSocket message itself is received whole.)
+    def handleUploadDataMsg(self, data, type, ws):
+        self.selectSession(ws)
+        header = json.loads(data) if isinstance(data, str) else data
+        words = header.pop('data')
+        return upload_data(self.socket, header, words)
+
+    # Handler for STREAM_DATA_MSG. Each batch of response data is forwarded to the WebSocket as it arrives. The host
+    # terminates the response with an empty batch, after which the client is sent {'type': 'STREAM_DATA_MSG', 'done': True}.
+    def handleStreamDataMsg(self, data, type, ws):
+        self.selectSession(ws)
+        self.socket.send_string("command", type)
+        self.socket.send_string("data", data)
+        while True:
+            batch = read_data_handler(self.socket, None, False)
+            if len(batch) == 0:
+                break
+            ws.write_message(batch)
+        return {'type': type, 'done': True}
+
+    # Host statistics as a JSON string.
+    def getStats(self):
+        self.socket.send_string("command", "STATS")
+        return read_data_handler(self.socket, None, False)
+
+    def handleStats(self, data, type, ws):
+        return {'type': type, 'stats': json.loads(self.getStats())}
+
+    # Saves the kernel context of the WebSocket's session as the host's checkpoint, for a warm start next time.
+    def handleSaveCheckpoint(self, data, type, ws):
+        self.selectSession(ws)
+        self.socket.send_string("command", type)
+        return {'type': type}
+
+    # Loads a memory of the (simulated) kernel directly, in the WebSocket's session. The response is the host's, e.g.
+    # {'type': 'LOAD_MEMORY', 'entries': 256} or {'type': 'LOAD_MEMORY', 'error': '...'}.
+    def handleLoadMemory(self, data, type, ws):
+        self.selectSession(ws)
+        self.socket.send_string("command", type)
+        self.socket.send_string("data", data if isinstance(data, str) else json.dumps(data))
+        response = json.loads(read_data_handler(self.socket, None, False))
+        response['type'] = type
+        return response
+
     def handlePing(self, data, type, ws):
         return {'type': type}
 
@@ -547,6 +623,8 @@ class FPGAServerApplication(tornado.web.Application):
         super(FPGAServerApplication, self).__init__(routes)
 
         self.socket = Socket(self.socket_filename)
+        self.session_cnt = 0
+        self.current_session = ""
 
         # Launch server (with SSL or not)
         self.use_ssl = self.args['ssl_key_file'] != None and self.args['ssl_crt_file'] != None
@@ -564,7 +642,12 @@ class FPGAServerApplication(tornado.web.Application):
         self.message_handlers = {}
         self.registerMessageHandler("GET_IMAGE", self.handleGetImage)
         self.registerMessageHandler("DATA_MSG", self.handleDataMsg)
+        self.registerMessageHandler("STREAM_DATA_MSG", self.handleStreamDataMsg)
+        self.registerMessageHandler("UPLOAD_DATA_MSG", self.handleUploadDataMsg)
         self.registerMessageHandler("PING", self.handlePing)
+        self.registerMessageHandler("STATS", self.handleStats)
+        self.registerMessageHandler("SAVE_CHECKPOINT", self.handleSaveCheckpoint)
+        self.registerMessageHandler("LOAD_MEMORY", self.handleLoadMemory)
         self.registerMessageHandler("START_TRACING", self.handleCommandMsg)
         self.registerMessageHandler("STOP_TRACING", self.handleCommandMsg)
 
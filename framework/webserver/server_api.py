@@ -47,6 +47,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 """
 
 import struct
+import json
 import base64
 import socket
 import sys
@@ -55,6 +56,7 @@ import traceback
 
 # Socket with host messages defines
 CHUNK_SIZE    = 4096
+UPLOAD_CHUNK_WORDS = 1024   # 512-bit words per message of UPLOAD_DATA_MSG data
 
 class Socket():
 
@@ -66,19 +68,23 @@ class Socket():
         self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
         server_address = (filename)
 
+        # The host listens as soon as it starts (initializing the kernel in the background), so retry promptly at first,
+        # backing off to 3s, for up to ~30s in total.
         connected = False
-        cnt = 0
+        waited = 0.0
+        delay = 0.1
         while not connected:
             try:
                 self.sock.connect(server_address)
                 connected = True
             except socket.error as e:
-                if cnt > 10:
+                if waited > 30:
                   print("Giving up.")
                   sys.exit(1)
                 print("Couldn't connect to host application via socket. Waiting...")
-                time.sleep(3)
-                cnt = cnt + 1
+                time.sleep(delay)
+                waited += delay
+                delay = min(delay * 2, 3)
 
 
     def send_string(self, tag, str):
@@ -128,6 +134,36 @@ def get_image(sock, header, payload, b64=True):
   image = read_data_handler(sock, None, b64)
   return image
 
+### This function requests several images from the host, which computes them together
+### Parameters:
+###   - sock     - socket channel with host
+###   - header   - command to be sent to the host
+###   - payloads - list of JSON strings of data for each image calculation
+###   - b64      - encode each image in base64 (as for get_image)
+### Returns a list of the images, in order.
+def get_images(sock, header, payloads, b64=True):
+  sock.send_string("command", header)
+  sock.send_string("images params", "[" + ",".join(payloads) + "]")
+
+  return [read_data_handler(sock, None, b64) for payload in payloads]
+
+### This function sends an UPLOAD_DATA_MSG, whose data the host feeds to the kernel as it arrives
+### Parameters:
+###   - sock    - socket channel with host
+###   - header  - dict of DATA_MSG fields other than "data" ("size" is set here)
+###   - words   - list of 512-bit words, each a list of 16 32-bit unsigned values
+### Returns the response (as for DATA_MSG) as a string.
+def upload_data(sock, header, words):
+  header["size"] = len(words)
+  sock.send_string("command", "UPLOAD_DATA_MSG")
+  sock.send_string("upload header", json.dumps(header))
+  for i in range(0, len(words), UPLOAD_CHUNK_WORDS):
+    chunk = b''.join(struct.pack("<16I", *word) for word in words[i:i + UPLOAD_CHUNK_WORDS])
+    sock.send("upload data size", struct.pack("I", socket.htonl(len(chunk))))
+    sock.send("upload data", chunk)
+
+  return read_data_handler(sock, None, False)
+
 ### This function reads data from the FPGA memory
 ### Parameters:
 ###   - sock        - socket channel with host